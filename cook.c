@@ -1,6 +1,8 @@
 #include "ipc_shared.h"
+#include "decisions.h"
 #include <signal.h>
 #include <time.h>
+#include <string.h>
 
 // Global IPC identifiers for cleanup
 int shmid = -1;
@@ -10,43 +12,74 @@ int semid = -1;
 void cleanup_handler(int sig) {
     printf("Cook process received signal %d, cleaning up...\n", sig);
     if (shmid != -1) shmctl(shmid, IPC_RMID, NULL);
-    if (semid != -1) semctl(semid, 0, IPC_RMID);
+    if (semid != -1) semset_remove(semid);
+    telemetry_remove();
     exit(1);
 }
 
 // Function to create and initialize shared memory
-int create_shared_memory() {
+int create_shared_memory(const config_t *config, int fast_forward) {
+    layout_t layout;
+    layout_init(&layout, config);
+    
     key_t key = get_key();
-    int id = shmget(key, SHM_SIZE * sizeof(int), IPC_CREAT | 0666);
+    int id = shmget(key, layout.size, IPC_CREAT | 0666);
     if (id == -1) {
         perror("shmget");
         exit(1);
     }
     
     // Attach to shared memory and initialize
-    int *shm = (int *)shmat(id, NULL, 0);
+    shared_t *shm = (shared_t *)shmat(id, NULL, 0);
     if (shm == (void *) -1) {
         perror("shmat");
         exit(1);
     }
+    memset(shm, 0, layout.size);
+    shm->config = *config;
+    shm->layout = layout;
     
     // Initialize shared memory
-    TIME(shm) = 0;                 // Current time (minutes after 11:00am)
-    EMPTY_TABLES(shm) = MAX_TABLES; // Initially all tables are empty
+    atomic_init(&shm->clock.minute, 0);   // Current time (minutes after 11:00am)
+    EMPTY_TABLES(shm) = config->tables; // Initially all tables are empty
     NEXT_WAITER(shm) = 0;          // Next waiter to serve
-    PENDING_ORDERS(shm) = 0;       // No pending orders initially
+    shm->tables.rng = 0x9e3779b9;  // Fixed seed keeps two-choices runs repeatable
+    atomic_init(&PENDING_ORDERS(shm), 0);   // No pending orders initially
+    shm->credits.free = config->queue_size;   // A credit per cook ring slot
+    for (int i = 0; i < config->tables; i++) {
+        FREE_SEATS(shm)[i] = i;
+    }
     
     // Initialize waiter queues
-    for (int i = 0; i < NUM_WAITERS; i++) {
-        shm[WAITER_FRONT(i)] = 0;
-        shm[WAITER_REAR(i)] = 0;
-        shm[WAITER_FOOD_READY(i)] = -1;       // No food ready
-        shm[WAITER_PENDING_ORDERS(i)] = 0;    // No pending orders
+    for (int i = 0; i < config->waiters; i++) {
+        atomic_init(&WAITER_PENDING_ORDERS(shm, i), 0);   // No pending orders
+        ring_init(WAITER_RING(shm, i), config->queue_size);
+        ring_init(WAITER_MAILBOX(shm, i), layout.mailbox_size);   // No food ready
     }
     
-    // Initialize cook queue
-    shm[COOK_FRONT] = 0;
-    shm[COOK_REAR] = 0;
+    // Initialize cook queue (the kitchen heap starts empty, zeroed above)
+    ring_init(COOK_RING(shm), config->queue_size);
+    for (int s = 1; s < config->stations; s++) {
+        ring_init(STATION_RING(shm, s), config->queue_size);
+        atomic_init(&STATION_SPACE(shm, s), config->queue_size);
+    }
+    
+    // Initialize event rings
+    if (config->event_log) {
+        for (int i = 0; i < EVENT_RINGS(config); i++) {
+            event_ring_init(EVENT_RING(shm, i));
+        }
+    }
+    
+    // Initialize virtual clock calendar (tokens/waiters zeroed above)
+    VCLOCK_ENABLED(shm) = fast_forward;
+    VCLOCK(shm)->runnable = 0;
+    VCLOCK(shm)->heap_size = 0;
+    
+    // Publish the layout header last so attachers only see a finished segment
+    shm->header.magic = SHM_MAGIC;
+    shm->header.version = SHM_VERSION;
+    shm->header.size = layout.size;
     
     printf("Shared memory initialized\n");
     
@@ -55,113 +88,520 @@ int create_shared_memory() {
     return id;
 }
 
-// Function to create and initialize semaphores
-int create_semaphores() {
-    key_t key = get_key();
-    int id = semget(key, TOTAL_SEMS, IPC_CREAT | 0666);
+// Function to create the live telemetry segment (see simtop.c). Counters
+// start at zero; roles publish into it from their first attach.
+void create_telemetry(const config_t *config) {
+    size_t size = TELEMETRY_SIZE(config);
+    int id = shmget(get_telemetry_key(), size, IPC_CREAT | 0644);
     if (id == -1) {
-        perror("semget");
+        perror("shmget: telemetry");
         exit(1);
     }
     
-    // Initialize semaphores
-    union semun arg;
-    unsigned short values[TOTAL_SEMS];
-    
-    // Initialize mutex to 1
-    values[MUTEX_SEM] = 1;
-    
-    // Initialize cook semaphore to 0
-    values[COOK_SEM] = 0;
+    telemetry_t *t = (telemetry_t *)shmat(id, NULL, 0);
+    if (t == (void *) -1) {
+        perror("shmat: telemetry");
+        exit(1);
+    }
+    memset(t, 0, size);
+    t->tables = config->tables;
+    t->waiters = config->waiters;
+    t->cooks = config->cooks;
+    t->seating.empty_tables = config->tables;
+    for (int i = 0; i < config->cooks + config->waiters; i++) {
+        t->roles[i].customer = -1;
+    }
     
-    // Initialize waiter semaphores to 0
-    for (int i = 0; i < NUM_WAITERS; i++) {
-        values[WAITER_SEM_BASE + i] = 0;
+    // Header last, as for the main segment
+    t->header.magic = TELEMETRY_MAGIC;
+    t->header.version = TELEMETRY_VERSION;
+    t->header.size = size;
+    shmdt(t);
+}
+
+// Function to create and initialize semaphores
+int create_semaphores(shared_t *shm) {
+    int nsems = TOTAL_SEMS(shm);
+    int id = semset_get(nsems, IPC_CREAT | 0666);
+    if (id == -1) {
+        perror("semget");
+        exit(1);
     }
     
-    // Initialize customer semaphores to 0
-    for (int i = 0; i < MAX_CUSTOMERS; i++) {
-        values[CUSTOMER_SEM_BASE + i] = 0;
+    // Initialize semaphores: signals, timers and seat wakeups start at 0
+    unsigned short *values = calloc(nsems, sizeof(unsigned short));
+    if (values == NULL) {
+        perror("calloc");
+        exit(1);
     }
     
-    arg.array = values;
-    if (semctl(id, 0, SETALL, arg) == -1) {
+    // Initialize lock domains to 1
+    values[TABLES_SEM] = 1;
+    values[KITCHEN_SEM] = 1;
+    values[CLOCK_SEM] = 1;
+    
+    if (semset_setall(id, values) == -1) {
         perror("semctl");
         exit(1);
     }
+    free(values);
     
     printf("Semaphores initialized\n");
     return id;
 }
 
+// Work dishes at a station, then pass them down the chain. Several dishes
+// are one batch of the same dish (see gather_batch). The plate station
+// sets aside every dish but an order's last; that one plates the whole
+// order and hands it to the waiter.
+static void work_dishes(shared_t *shm, int semid, int cook_id, int station, order_t *dishes, int n) {
+    int kind = shm->config.station_kind[station];
+    int dish = order_dish(&dishes[0]);
+    int minutes;
+    if (kind == STATION_PLATE) {
+        if (atomic_fetch_sub(KITCHEN_TICKET(shm, dishes[0].seat), 1) > 1) {
+            return;
+        }
+        minutes = PLATE_MINUTES_PER_ORDER;
+        log_event(shm, EV_COOK_PLATING, cook_id, dishes[0].customer_id, dishes[0].count,
+                  dishes[0].waiter_id);
+    } else {
+        minutes = batch_minutes(&shm->config, menu[dish].minutes[kind], n);
+    }
+    
+    // The first station also sees dishes it has nothing to do for
+    if (minutes > 0) {
+        if (kind != STATION_PLATE) {
+            for (int i = 0; i < n; i++) {
+                log_event(shm, EV_COOK_DISH, cook_id, dishes[i].customer_id, dish, kind);
+            }
+        }
+        if (n > 1) {
+            log_event(shm, EV_COOK_BATCH, cook_id, dish, n, minutes);
+            atomic_fetch_add(&shm->stats.cooks.batches, 1);
+            atomic_fetch_add(&shm->stats.cooks.batched, n);
+            atomic_fetch_add(&shm->stats.cooks.batch_saved, n * menu[dish].minutes[kind] - minutes);
+        }
+        telemetry_cook(cook_id, clock_now(shm), dishes[0].customer_id, 0, 0);
+        update_time(shm, semid, COOK_TIMER_SEM(shm, cook_id), minutes);
+        atomic_fetch_add(&shm->stats.cooks.busy, minutes);
+        atomic_fetch_add(&shm->stats.cooks.station_busy[station], minutes);
+        atomic_fetch_add(&shm->stats.cooks.station_done[station], n);
+        telemetry_cook(cook_id, clock_now(shm), -1, kind == STATION_PLATE, minutes);
+    }
+    
+    if (kind == STATION_PLATE) {
+        add_food_ready(shm, &dishes[0]);
+        log_event(shm, EV_COOK_FINISHED, cook_id, dishes[0].customer_id, 0, 0);
+        signal_event(shm, semid, WAITER_SEM(shm, dishes[0].waiter_id));
+        close_order(shm, semid);
+        return;
+    }
+    
+    // Hand the dishes on, reserving a slot in the next station's queue for
+    // each and waiting for a cook there to free one when it is full. The
+    // plate station never waits on anyone, so the chain drains.
+    int next = next_station(&shm->config, station, dish);
+    for (int i = 0; i < n; i++) {
+        if (atomic_fetch_sub(&STATION_SPACE(shm, next), 1) <= 0) {
+            wait_event(shm, semid, STATION_SPACE_SEM(shm, next));
+        }
+        if (!ring_push(STATION_RING(shm, next), &dishes[i])) {
+            fprintf(stderr, "station ring overflowed with a slot reserved\n");
+            exit(1);
+        }
+        signal_event(shm, semid, STATION_SEM(shm, next));
+    }
+}
+
+// Batch cooking: add queued dishes of the same kind to the one in batch[0],
+// holding a short batch open a minute at a time for up to batch_wait
+// minutes. Returns the batch size.
+static int gather_batch(shared_t *shm, int semid, int cook_id, order_t *batch) {
+    int max = shm->config.batch_max;
+    int dish = order_dish(&batch[0]);
+    if (max <= 1 || menu[dish].minutes[shm->config.station_kind[0]] == 0) {
+        return 1;
+    }
+    
+    int n = 1 + get_cooking_batch(shm, semid, dish, batch + 1, max - 1);
+    kitchen_release(shm, semid, n - 1);
+    for (int held = 0; n < max && held < shm->config.batch_wait; held++) {
+        update_time(shm, semid, COOK_TIMER_SEM(shm, cook_id), 1);
+        int more = get_cooking_batch(shm, semid, dish, batch + n, max - n);
+        kitchen_release(shm, semid, more);
+        n += more;
+    }
+    return n;
+}
+
+// Cooks at a station after the first: take dishes off the station's ring
+// until the restaurant has closed and every order has been plated
+static void station_main(shared_t *shm, int semid, int cook_id, int station) {
+    while (1) {
+        wait_event(shm, semid, STATION_SEM(shm, station));
+        if (restaurant_closed(shm) && atomic_load(&OPEN_ORDERS(shm)) == 0) {
+            return;
+        }
+        
+        // A slot freed with a cook upstream waiting for one goes to it
+        order_t order;
+        if (ring_pop(STATION_RING(shm, station), &order)) {
+            if (atomic_fetch_add(&STATION_SPACE(shm, station), 1) < 0) {
+                signal_event(shm, semid, STATION_SPACE_SEM(shm, station));
+            }
+            work_dishes(shm, semid, cook_id, station, &order, 1);
+        }
+    }
+}
+
+// A cook leaving the session
+static void cook_leave(shared_t *shm, int semid, int cook_id) {
+    vclock_leave(shm, semid);
+    
+    log_event(shm, EV_COOK_TERMINATED, cook_id, 0, 0, 0);
+    
+    // Detach from shared memory
+    shmdt(shm);
+    exit(0);
+}
+
 // Function executed by each cook process
 void cmain(int cook_id, int shmid, int semid) {
-    printf("Cook %c started (PID: %d)\n", 'C' + cook_id, getpid());
-    
     // Attach to shared memory
-    int *shm = (int *)shmat(shmid, NULL, 0);
-    if (shm == (void *) -1) {
-        perror("shmat in cook");
-        exit(1);
-    }
+    shared_t *shm = attach_shared_memory(shmid);
+    log_event(shm, EV_COOK_STARTED, cook_id, getpid(), 0, 0);
     
-    int is_last_cook = 0;
+    int station = cook_station(&shm->config, cook_id);
+    if (station > 0) {
+        station_main(shm, semid, cook_id, station);
+        cook_leave(shm, semid, cook_id);
+    }
     
     while (1) {
         // Wait for a cooking request
-        take(semid, COOK_SEM);
+        wait_event(shm, semid, COOK_SEM);
+        
+        // Any idle cook may take the wakeup, so on replay this cycle runs
+        // under the id the recording gave it
+        cook_id = decision_begin(shm, semid, DECISION_COOK(cook_id), DECISION_COOK_TAKE);
         
         // Check if it's time to end the session
-        take(semid, MUTEX_SEM);
-        if (TIME(shm) >= 180 && PENDING_ORDERS(shm) == 0) {
-            // Time is past 3:00pm and no more orders
-            is_last_cook = 1;
-            put(semid, MUTEX_SEM);
+        if (restaurant_closed(shm) && atomic_load(&PENDING_ORDERS(shm)) == 0) {
+            // Time is past 3:00pm and no more orders: this is the last cook,
+            // wake all waiters
+            log_event(shm, EV_COOK_LAST, cook_id, 0, 0, 0);
+            for (int i = 0; i < shm->config.waiters; i++) {
+                signal_event(shm, semid, WAITER_SEM(shm, i));
+            }
+            if (atomic_load(&OPEN_ORDERS(shm)) == 0) {
+                wake_stations(shm, semid);
+            }
+            decision_end(shm, semid, -1);
             break;
         }
         
         // Process cooking request
-        if (shm[COOK_FRONT] != shm[COOK_REAR]) {
-            int waiter_id, customer_id, count;
-            get_cooking_request(shm, &waiter_id, &customer_id, &count);
-            
-            printf("Cook %c preparing food for customer %d (party size: %d, waiter: %c)\n", 
-                   'C' + cook_id, customer_id, count, 'U' + waiter_id);
-            
-            put(semid, MUTEX_SEM);
-            
-            // Simulate cooking time (5 minutes per person)
-            update_time(shm, count * 5);
-            
-            take(semid, MUTEX_SEM);
-            
-            // Notify waiter that food is ready
-            shm[WAITER_FOOD_READY(waiter_id)] = customer_id;
-            printf("Cook %c finished preparing food for customer %d\n", 'C' + cook_id, customer_id);
-            
-            // Signal the waiter
-            put(semid, MUTEX_SEM);
-            put(semid, WAITER_SEM_BASE + waiter_id);
-        } else {
-            put(semid, MUTEX_SEM);
-        }
-    }
-    
-    // If this is the last cook, wake all waiters
-    if (is_last_cook) {
-        printf("Cook %c is the last cook, waking all waiters to end session\n", 'C' + cook_id);
-        for (int i = 0; i < NUM_WAITERS; i++) {
-            put(semid, WAITER_SEM_BASE + i);
+        order_t order;
+        if (!get_cooking_request(shm, semid, &order)) {
+            decision_end(shm, semid, -1);
+            continue;
         }
+        kitchen_release(shm, semid, 1);
+        
+        // With stations this is one dish, and the cook runs the first station
+        if (station == 0) {
+            decision_end(shm, semid, order.customer_id);
+            order_t batch[MAX_BATCH];
+            batch[0] = order;
+            int n = gather_batch(shm, semid, cook_id, batch);
+            for (int i = 0; i < n; i++) {
+                if (batch[i].item == 0) {
+                    LIFECYCLE(shm, batch[i].seat)->cook_start = clock_now(shm);
+                }
+            }
+            work_dishes(shm, semid, cook_id, station, batch, n);
+            continue;
+        }
+        
+        int waiter_id = order.waiter_id;
+        log_event(shm, EV_COOK_PREPARING, cook_id, order.customer_id, order.count, waiter_id);
+        
+        // Simulate cooking time (5 minutes per person)
+        int minutes = order.count * COOK_MINUTES_PER_PERSON;
+        LIFECYCLE(shm, order.seat)->cook_start = clock_now(shm);
+        telemetry_cook(cook_id, clock_now(shm), order.customer_id, 0, 0);
+        decision_end(shm, semid, order.customer_id);
+        update_time(shm, semid, COOK_TIMER_SEM(shm, cook_id), minutes);
+        atomic_fetch_add(&shm->stats.cooks.busy, minutes);
+        telemetry_cook(cook_id, clock_now(shm), -1, 1, minutes);
+        
+        // Notify waiter that food is ready
+        decision_begin(shm, semid, DECISION_COOK(cook_id), DECISION_COOK_DONE);
+        add_food_ready(shm, &order);
+        log_event(shm, EV_COOK_FINISHED, cook_id, order.customer_id, 0, 0);
+        
+        // Signal the waiter
+        signal_event(shm, semid, WAITER_SEM(shm, waiter_id));
+        decision_end(shm, semid, order.customer_id);
     }
     
-    // Detach from shared memory
+    cook_leave(shm, semid, cook_id);
+}
+
+// Event logger: drains every event ring into a file until the segment has
+// been removed and everyone else has detached, so the roles' last events
+// are kept too. Not a virtual clock participant; it never blocks a role.
+// Uses the mapping inherited from the cook parent, so it holds exactly one
+// attachment.
+void lmain(shared_t *shm, int shmid, const char *path) {
+    int rings = EVENT_RINGS(&shm->config);
+    
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        perror("Error opening event log");
+        exit(1);
+    }
+    setvbuf(out, NULL, _IOFBF, 1 << 20);
+    event_file_header_t header = { EVENT_MAGIC, EVENT_VERSION, sizeof(event_t), 0 };
+    fwrite(&header, sizeof(header), 1, out);
+    
+    int last_pass = 0;
+    while (1) {
+        int drained = 0;
+        event_t ev;
+        for (int i = 0; i < rings; i++) {
+            while (event_pop(EVENT_RING(shm, i), &ev)) {
+                fwrite(&ev, sizeof(ev), 1, out);
+                drained++;
+            }
+        }
+        if (last_pass) break;
+        
+        if (drained == 0) {
+            struct shmid_ds ds;
+            if (shmctl(shmid, IPC_STAT, &ds) == -1 ||
+                ((ds.shm_perm.mode & SHM_DEST) && ds.shm_nattch <= 1)) {
+                last_pass = 1;   // One more sweep for anything pushed meanwhile
+                continue;
+            }
+            fflush(out);
+            usleep(1000);
+        }
+    }
+    
+    // Account for events lost to full rings
+    unsigned dropped = 0;
+    for (int i = 0; i < rings; i++) {
+        dropped += atomic_load(&EVENT_RING(shm, i)->dropped);
+    }
+    if (dropped > 0) {
+        event_t ev = { 0 };
+        ev.ns = UINT64_MAX;   // Sorts after every real event
+        ev.type = EV_DROPPED;
+        ev.a = dropped;
+        fwrite(&ev, sizeof(ev), 1, out);
+    }
+    
+    fclose(out);
     shmdt(shm);
-    printf("Cook %c terminated\n", 'C' + cook_id);
     exit(0);
 }
 
-int main() {
+// Decision recorder: once the session is over and every role has detached,
+// write the decision log for a later `cook -P`. Runs in the cook parent.
+void write_decisions(shared_t *shm, int shmid, const char *path, int fast_forward) {
+    struct shmid_ds ds;
+    while (shmctl(shmid, IPC_STAT, &ds) == 0 &&
+           !((ds.shm_perm.mode & SHM_DEST) && ds.shm_nattch <= 1)) {
+        usleep(10000);
+    }
+    
+    decision_log_t *log = DECISION_LOG(shm);
+    unsigned long count = atomic_load(&log->turn);
+    int truncated = atomic_load(&log->overflow);
+    if (count > (unsigned long)shm->config.decision_capacity) {
+        count = shm->config.decision_capacity;
+    }
+    
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        perror("Error opening decision log");
+        exit(1);
+    }
+    decision_file_header_t header = { DECISION_MAGIC, DECISION_VERSION, shm->config,
+                                      fast_forward, truncated, count };
+    fwrite(&header, sizeof(header), 1, out);
+    fwrite(log->records, sizeof(decision_t), count, out);
+    fclose(out);
+    
+    printf("Recorded %lu decisions to %s%s\n", count, path,
+           truncated ? " (truncated, cannot be replayed)" : "");
+}
+
+// Read a decision log header; the session replays with the recorded
+// configuration. Leaves the file positioned at the first record.
+FILE *open_decisions(const char *path, config_t *config, int *fast_forward) {
+    FILE *in = fopen(path, "r");
+    if (in == NULL) {
+        perror("Error opening decision log");
+        exit(1);
+    }
+    decision_file_header_t header;
+    if (fread(&header, sizeof(header), 1, in) != 1 || header.magic != DECISION_MAGIC ||
+        header.version != DECISION_VERSION) {
+        fprintf(stderr, "%s: not a decision log\n", path);
+        exit(1);
+    }
+    if (header.truncated) {
+        fprintf(stderr, "%s: recording was truncated and cannot be replayed\n", path);
+        exit(1);
+    }
+    
+    int event_log = config->event_log;
+    *config = header.config;
+    config->event_log = event_log;
+    config->decisions = DECISIONS_REPLAY;
+    config->decision_capacity = header.count;
+    *fast_forward = header.fast_forward;
+    return in;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-f] [-s] [-t tables] [-w waiters] [-c cooks] [-q queue_size]\n"
+            "          [-a rr|least|p2c] [-k fifo|sjf|deadline] [-l event_log]\n"
+            "          [-S station:cooks,... [-B size[,hold[,extra]]]]\n"
+            "          [-R decisions | -P decisions] [-N instance]\n"
+            "  -f  run on the virtual clock (fast-forward)\n"
+            "  -a  waiter assignment: round-robin, least pending orders, or power of two choices\n"
+            "  -s  let idle waiters steal orders from the busiest waiter\n"
+            "  -k  kitchen order: as submitted, smallest party first, or earliest deadline\n"
+            "  -S  cook dish by dish down a chain of prep, cook and plate stations ending\n"
+            "      in plate, e.g. prep:1,cook:2,plate:1; replaces -c\n"
+            "  -B  first-station cooks make up to size identical dishes at once, holding a\n"
+            "      short batch open for up to hold minutes (default 0); each extra portion\n"
+            "      costs extra percent of one (default 25)\n"
+            "  -l  record role events in binary to this file instead of printing them\n"
+            "  -R  record every scheduling decision to this file\n"
+            "  -P  replay the decisions in this file, with its staffing and policies\n"
+            "  -N  instance name, so several sessions can share a host (or $" INSTANCE_ENV ")\n", prog);
+    exit(1);
+}
+
+// Parse a station chain such as prep:1,cook:2,plate:1 into the config and
+// staff the kitchen with its cooks. Returns 0 if the chain is malformed.
+static int parse_stations(char *spec, config_t *config) {
+    config->stations = 0;
+    config->cooks = 0;
+    for (char *tok = strtok(spec, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        char *colon = strchr(tok, ':');
+        int cooks = 1;
+        if (colon != NULL) {
+            *colon = '\0';
+            cooks = atoi(colon + 1);
+        }
+        int kind = 0;
+        while (kind < NUM_STATION_KINDS && strcmp(tok, station_kind_names[kind]) != 0) kind++;
+        if (kind == NUM_STATION_KINDS || cooks <= 0 || config->stations == MAX_STATIONS) {
+            return 0;
+        }
+        config->station_kind[config->stations] = kind;
+        config->station_cooks[config->stations] = cooks;
+        config->stations++;
+        config->cooks += cooks;
+    }
+    
+    // Plating assembles whole orders, so it ends the chain and only ends it
+    for (int s = 0; s < config->stations; s++) {
+        if ((config->station_kind[s] == STATION_PLATE) != (s == config->stations - 1)) {
+            return 0;
+        }
+    }
+    return config->stations > 0;
+}
+
+int main(int argc, char *argv[]) {
+    int fast_forward = 0;
+    char *station_spec = NULL;
+    int batch = 0;
+    const char *log_path = NULL;
+    const char *record_path = NULL, *replay_path = NULL;
+    config_t config = { DEFAULT_TABLES, DEFAULT_WAITERS, DEFAULT_COOKS, DEFAULT_QUEUE_SIZE,
+                        ASSIGN_ROUND_ROBIN, 0, KITCHEN_FIFO, 0 };
+    
+    int opt;
+    while ((opt = getopt(argc, argv, "fst:w:c:q:a:k:S:B:l:R:P:N:")) != -1) {
+        switch (opt) {
+        case 'f': fast_forward = 1; break;   // Virtual clock instead of wall-clock sleeps
+        case 't': config.tables = atoi(optarg); break;
+        case 'w': config.waiters = atoi(optarg); break;
+        case 'c': config.cooks = atoi(optarg); break;
+        case 'q': config.queue_size = atoi(optarg); break;
+        case 's': config.steal = 1; break;
+        case 'S': station_spec = optarg; break;
+        case 'B':
+            batch = 1;
+            config.batch_wait = 0;
+            config.batch_extra = DEFAULT_BATCH_EXTRA;
+            if (sscanf(optarg, "%d,%d,%d", &config.batch_max, &config.batch_wait,
+                       &config.batch_extra) < 1) {
+                usage(argv[0]);
+            }
+            break;
+        case 'l': config.event_log = 1; log_path = optarg; break;
+        case 'R': record_path = optarg; break;
+        case 'P': replay_path = optarg; break;
+        case 'N': set_instance(optarg); break;
+        case 'a':
+            if (strcmp(optarg, "rr") == 0) config.assign_policy = ASSIGN_ROUND_ROBIN;
+            else if (strcmp(optarg, "least") == 0) config.assign_policy = ASSIGN_LEAST_PENDING;
+            else if (strcmp(optarg, "p2c") == 0) config.assign_policy = ASSIGN_TWO_CHOICES;
+            else usage(argv[0]);
+            break;
+        case 'k':
+            if (strcmp(optarg, "fifo") == 0) config.kitchen_policy = KITCHEN_FIFO;
+            else if (strcmp(optarg, "sjf") == 0) config.kitchen_policy = KITCHEN_SJF;
+            else if (strcmp(optarg, "deadline") == 0) config.kitchen_policy = KITCHEN_DEADLINE;
+            else usage(argv[0]);
+            break;
+        default: usage(argv[0]);
+        }
+    }
+    if (station_spec && !parse_stations(station_spec, &config)) {
+        usage(argv[0]);
+    }
+    
+    // Batches are of one dish, so they need the kitchen to work dish by dish
+    if (batch && (!station_spec || config.batch_max < 1 || config.batch_max > MAX_BATCH ||
+                  config.batch_wait < 0 || config.batch_extra < 0 || config.batch_extra > 100)) {
+        usage(argv[0]);
+    }
+    
+    // Any idle cook may take a recorded cook-take on replay, which only
+    // holds when every cook does the same work
+    if (station_spec && (record_path || replay_path)) {
+        fprintf(stderr, "%s: -S cannot be combined with -R or -P\n", argv[0]);
+        exit(1);
+    }
+    if (config.tables <= 0 || config.waiters <= 0 || config.cooks <= 0 || config.queue_size <= 0 ||
+        (record_path && replay_path)) {
+        usage(argv[0]);
+    }
+    
+    FILE *replay = NULL;
+    if (record_path) {
+        config.decisions = DECISIONS_RECORD;
+        config.decision_capacity = DECISION_CAPACITY;
+    } else if (replay_path) {
+        replay = open_decisions(replay_path, &config, &fast_forward);
+    }
+    
+    // Ring positions wrap with a mask, so round the capacity up to a power of
+    // two; a ring needs two slots or a full slot looks free (see ring_init)
+    int queue_size = 2;
+    while (queue_size < config.queue_size) queue_size *= 2;
+    config.queue_size = queue_size;
+    
     // Set up signal handlers
     signal(SIGINT, cleanup_handler);
     signal(SIGTERM, cleanup_handler);
@@ -169,28 +609,62 @@ int main() {
     printf("Restaurant simulation starting...\n");
     
     // Create and initialize IPC resources
-    shmid = create_shared_memory();
-    semid = create_semaphores();
+    create_telemetry(&config);
+    shmid = create_shared_memory(&config, fast_forward);
+    shared_t *shm = attach_shared_memory(shmid);
+    semid = create_semaphores(shm);
     
-    // Fork cook processes
-    pid_t pid1 = fork();
-    if (pid1 == 0) {
-        // Cook C
-        cmain(0, shmid, semid);
-        exit(0);
+    if (replay) {
+        decision_log_t *log = DECISION_LOG(shm);
+        log->count = fread(log->records, sizeof(decision_t), config.decision_capacity, replay);
+        fclose(replay);
+        printf("Replaying %lu decisions from %s\n", log->count, replay_path);
     }
     
-    pid_t pid2 = fork();
-    if (pid2 == 0) {
-        // Cook D
-        cmain(1, shmid, semid);
-        exit(0);
+    // Start the event logger before any role can fill a ring
+    pid_t logger = -1;
+    if (config.event_log) {
+        fflush(stdout);
+        logger = fork();
+        if (logger == 0) {
+            lmain(shm, shmid, log_path);
+        }
+    }
+    
+    // Fork cook processes
+    pid_t *pids = malloc(config.cooks * sizeof(pid_t));
+    if (pids == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    for (int i = 0; i < config.cooks; i++) {
+        vclock_join(shm, semid);
+        fflush(stdout);
+        pids[i] = fork();
+        if (pids[i] == 0) {
+            // Cook C, D, ...
+            cmain(i, shmid, semid);
+            exit(0);
+        }
+        atomic_fetch_add(&shm->staffed.cooks, 1);
+    }
+    if (!record_path) {
+        shmdt(shm);
     }
     
     // Wait for cook processes to finish
     printf("Waiting for cooks to finish...\n");
-    wait(NULL);
-    wait(NULL);
+    for (int i = 0; i < config.cooks; i++) {
+        waitpid(pids[i], NULL, 0);
+    }
+    free(pids);
+    if (logger > 0) {
+        waitpid(logger, NULL, 0);
+    }
+    if (record_path) {
+        write_decisions(shm, shmid, record_path, fast_forward);
+        shmdt(shm);
+    }
     
     printf("All cooks have finished. Exiting cook parent process.\n");
     exit(0);
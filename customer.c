@@ -1,86 +1,662 @@
 #include "ipc_shared.h"
+#include "decisions.h"
+#include "trace_format.h"
 #include <time.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <stdint.h>
 
-// Function executed by each customer process
-void cmain(int customer_id, int arrival_time, int party_size, int shmid, int semid) {
-    // Attach to shared memory
-    int *shm = (int *)shmat(shmid, NULL, 0);
-    if (shm == (void *) -1) {
-        perror("shmat in customer");
-        exit(1);
-    }
-    
-    printf("Customer %d (party size: %d) arrived at %d minutes after 11:00am\n", 
-           customer_id, party_size, arrival_time);
+#define EAT_MINUTES 30
+
+// Arrival: advance the clock, then take a table and a waiter. Returns 0 if
+// the customer left (closed or no table), else fills in the order.
+static int seat_customer(shared_t *shm, int semid, int customer_id, int arrival_time,
+                         int party_size, order_t *order) {
+    log_event(shm, EV_CUSTOMER_ARRIVED, 0, customer_id, party_size, arrival_time);
     
-    // Set arrival time if it's greater than current time
-    take(semid, MUTEX_SEM);
-    if (arrival_time > TIME(shm)) {
-        TIME(shm) = arrival_time;
-    }
+    // Move the clock up to our arrival
+    clock_advance(shm, arrival_time);
     
     // Check if restaurant is still open
-    if (TIME(shm) >= 180) { // 3:00pm = 180 minutes after 11:00am
-        printf("Customer %d arrived after closing time and left\n", customer_id);
-        put(semid, MUTEX_SEM);
-        shmdt(shm);
-        exit(0);
+    if (restaurant_closed(shm)) {
+        log_event(shm, EV_CUSTOMER_CLOSED, 0, customer_id, 0, 0);
+        return 0;
     }
     
     // Check if table is available
+    decision_begin(shm, semid, DECISION_CUSTOMER(shm, customer_id), DECISION_SEAT);
+    take_lock(semid, TABLES_SEM);
+    atomic_fetch_add(&shm->stats.customers.arrived, 1);
     if (EMPTY_TABLES(shm) <= 0) {
-        printf("Customer %d couldn't find an empty table and left\n", customer_id);
-        put(semid, MUTEX_SEM);
-        shmdt(shm);
-        exit(0);
+        atomic_fetch_add(&shm->stats.customers.turned_away, 1);
+        telemetry_seating(clock_now(shm), EMPTY_TABLES(shm), 0, 1, 0);
+        log_event(shm, EV_CUSTOMER_NO_TABLE, 0, customer_id, 0, 0);
+        put(semid, TABLES_SEM);
+        decision_end(shm, semid, -1);
+        return 0;
     }
     
-    // Occupy a table
-    EMPTY_TABLES(shm)--;
-    printf("Customer %d occupied a table (%d tables remaining)\n", 
-           customer_id, EMPTY_TABLES(shm));
+    // Occupy a table; its seat semaphore is our wakeup until we leave
+    int seat = FREE_SEATS(shm)[--EMPTY_TABLES(shm)];
+    telemetry_seating(clock_now(shm), EMPTY_TABLES(shm), 1, 0, 0);
+    log_event(shm, EV_CUSTOMER_SEATED, 0, customer_id, EMPTY_TABLES(shm), 0);
     
     // Get assigned waiter
-    int waiter_id = NEXT_WAITER(shm);
-    NEXT_WAITER(shm) = (waiter_id + 1) % NUM_WAITERS;
+    int waiter_id = assign_waiter(shm);
+    int seated_at = clock_now(shm);
+    if (shm->config.stations > 0) {
+        atomic_fetch_add(&OPEN_ORDERS(shm), 1);   // Until plated (see close_order)
+    }
+    LIFECYCLE(shm, seat)->arrived = arrival_time;
+    LIFECYCLE(shm, seat)->seated = seated_at;
+    put(semid, TABLES_SEM);
+    decision_end(shm, semid, seat);
+    
+    order_t seated = { waiter_id, customer_id, party_size, seat, seated_at };
+    *order = seated;
+    return 1;
+}
+
+// Add the order to the waiter's queue and wake them. Returns 0 if the queue
+// was full, in which case the table has been given back.
+static int place_order(shared_t *shm, int semid, const order_t *order) {
+    int waiter_id = order->waiter_id;
     
-    // Add to waiter's queue
-    int rear = shm[WAITER_REAR(waiter_id)];
-    shm[WAITER_QUEUE_START(waiter_id) + rear*2] = customer_id;
-    shm[WAITER_QUEUE_START(waiter_id) + rear*2 + 1] = party_size;
-    shm[WAITER_REAR(waiter_id)] = (rear + 1) % QUEUE_SIZE;
-    shm[WAITER_PENDING_ORDERS(waiter_id)]++;
+    decision_begin(shm, semid, DECISION_CUSTOMER(shm, order->customer_id), DECISION_ORDER);
+    if (!add_waiter_request(shm, order)) {
+        take_lock(semid, TABLES_SEM);
+        FREE_SEATS(shm)[EMPTY_TABLES(shm)++] = order->seat;
+        atomic_fetch_add(&shm->stats.customers.turned_away, 1);
+        atomic_fetch_add(&shm->stats.customers.rejected, 1);
+        telemetry_seating(clock_now(shm), EMPTY_TABLES(shm), 0, 1, 0);
+        log_event(shm, EV_CUSTOMER_QUEUE_FULL, 0, order->customer_id, waiter_id, 0);
+        put(semid, TABLES_SEM);
+        if (shm->config.stations > 0) {
+            close_order(shm, semid);
+        }
+        decision_end(shm, semid, 0);
+        return 0;
+    }
     
-    printf("Customer %d is assigned to waiter %c\n", customer_id, 'U' + waiter_id);
+    log_event(shm, EV_CUSTOMER_ASSIGNED, 0, order->customer_id, waiter_id, 0);
     
     // Signal waiter
-    put(semid, WAITER_SEM_BASE + waiter_id);
-    put(semid, MUTEX_SEM);
+    signal_event(shm, semid, WAITER_SEM(shm, waiter_id));
     
-    // Wait for food to be served
-    take(semid, CUSTOMER_SEM_BASE + customer_id);
-    
-    printf("Customer %d received food and is eating\n", customer_id);
+    // If our waiter is backed up, wake one idle waiter so it can steal
+    if (shm->config.steal && atomic_load(&WAITER_PENDING_ORDERS(shm, waiter_id)) > 1) {
+        for (int w = 0; w < shm->config.waiters; w++) {
+            int idle = 1;
+            if (w != waiter_id && atomic_compare_exchange_strong(&WAITER_AREA(shm, w)->idle, &idle, 0)) {
+                signal_event(shm, semid, WAITER_SEM(shm, w));
+                break;
+            }
+        }
+    }
+    decision_end(shm, semid, 1);
+    return 1;
+}
+
+// The waiter has signalled the seat semaphore
+static void food_served(shared_t *shm, const order_t *order) {
+    record_latency(&shm->stats.customers.food, clock_now(shm) - order->queued_at);
+    log_event(shm, EV_CUSTOMER_EATING, 0, order->customer_id, 0, 0);
+}
+
+// Free the table
+static void leave_table(shared_t *shm, int semid, const order_t *order) {
+    decision_begin(shm, semid, DECISION_CUSTOMER(shm, order->customer_id), DECISION_LEAVE);
+    take_lock(semid, TABLES_SEM);
+    record_lifecycle(shm, order->seat);
+    FREE_SEATS(shm)[EMPTY_TABLES(shm)++] = order->seat;
+    telemetry_seating(clock_now(shm), EMPTY_TABLES(shm), 0, 0, 1);
+    log_event(shm, EV_CUSTOMER_LEFT, 0, order->customer_id, EMPTY_TABLES(shm), 0);
+    put(semid, TABLES_SEM);
+    decision_end(shm, semid, order->seat);
+}
+
+// Function executed by each customer process
+void cmain(int customer_id, int arrival_time, int party_size, int shmid, int semid) {
+    // Attach to shared memory
+    shared_t *shm = attach_shared_memory(shmid);
     
-    // Eat food (30 minutes)
-    update_time(shm, 30);
+    order_t order;
+    if (seat_customer(shm, semid, customer_id, arrival_time, party_size, &order) &&
+        place_order(shm, semid, &order)) {
+        // Wait for food to be served
+        wait_event(shm, semid, SEAT_SEM(shm, order.seat));
+        food_served(shm, &order);
+        
+        // Eat food (30 minutes)
+        update_time(shm, semid, SEAT_SEM(shm, order.seat), EAT_MINUTES);
+        leave_table(shm, semid, &order);
+    }
     
-    // Free the table
-    take(semid, MUTEX_SEM);
-    EMPTY_TABLES(shm)++;
-    printf("Customer %d finished eating and left (%d tables now available)\n", 
-           customer_id, EMPTY_TABLES(shm));
-    put(semid, MUTEX_SEM);
+    vclock_leave(shm, semid);
     
     // Detach from shared memory
     shmdt(shm);
     exit(0);
 }
 
-int main() {
-    FILE *fp;
-    int customer_id, arrival_time, party_size;
-    int prev_arrival_time = 0;
+// Write one stage histogram as a JSON object
+static void write_hist_json(FILE *out, const char *name, latency_hist_t *hist, int last) {
+    fprintf(out, "    \"%s\": {\"count\": %d, \"mean\": %.2f, \"p50\": %d, \"p90\": %d, "
+            "\"p99\": %d, \"max\": %d}%s\n",
+            name, atomic_load(&hist->count), latency_mean(hist),
+            latency_percentile(hist, 50), latency_percentile(hist, 90),
+            latency_percentile(hist, 99), atomic_load(&hist->max), last ? "" : ",");
+}
+
+// Export per-stage latency histograms and staff utilization for dashboards.
+// Times are simulated minutes; utilization is busy minutes over the session.
+static void write_session_json(shared_t *shm, const char *path) {
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        perror("Error opening stats output");
+        return;
+    }
+    
+    int minutes = clock_now(shm);
+    if (minutes <= 0) minutes = 1;
+    fprintf(out, "{\n");
+    fprintf(out, "  \"config\": {\"tables\": %d, \"waiters\": %d, \"cooks\": %d, "
+            "\"assign\": \"%s\", \"steal\": %d, \"kitchen\": \"%s\"},\n",
+            shm->config.tables, shm->config.waiters, shm->config.cooks,
+            assign_policy_names[shm->config.assign_policy], shm->config.steal,
+            kitchen_policy_names[shm->config.kitchen_policy]);
+    fprintf(out, "  \"session_minutes\": %d,\n", minutes);
+    fprintf(out, "  \"arrived\": %d,\n", atomic_load(&shm->stats.customers.arrived));
+    fprintf(out, "  \"turned_away\": %d,\n", atomic_load(&shm->stats.customers.turned_away));
+    fprintf(out, "  \"served\": %d,\n", atomic_load(&shm->stats.customers.food.count));
+    fprintf(out, "  \"stages\": {\n");
+    for (int i = 0; i < NUM_STAGES; i++) {
+        write_hist_json(out, stage_names[i], &shm->stats.customers.stages[i], 0);
+    }
+    write_hist_json(out, "seated_to_served", &shm->stats.customers.food, 1);
+    fprintf(out, "  },\n");
+    if (shm->config.stations > 0) {
+        fprintf(out, "  \"stations\": [\n");
+        for (int s = 0; s < shm->config.stations; s++) {
+            fprintf(out, "    {\"kind\": \"%s\", \"cooks\": %d, \"done\": %ld, \"utilization\": %.3f}%s\n",
+                    station_kind_names[shm->config.station_kind[s]], shm->config.station_cooks[s],
+                    atomic_load(&shm->stats.cooks.station_done[s]),
+                    (double)atomic_load(&shm->stats.cooks.station_busy[s]) /
+                    ((long)shm->config.station_cooks[s] * minutes),
+                    s == shm->config.stations - 1 ? "" : ",");
+        }
+        fprintf(out, "  ],\n");
+    }
+    fprintf(out, "  \"kitchen_queue\": {\"capacity\": %d, \"high_water\": %d, \"blocked\": %d, "
+            "\"blocked_minutes\": %ld, \"rejected\": %d},\n", shm->config.queue_size,
+            atomic_load(&shm->stats.waiters.kitchen_high),
+            atomic_load(&shm->stats.waiters.kitchen_blocks),
+            atomic_load(&shm->stats.waiters.kitchen_blocked),
+            atomic_load(&shm->stats.customers.rejected));
+    if (shm->config.batch_max > 1) {
+        fprintf(out, "  \"batching\": {\"max\": %d, \"hold\": %d, \"extra\": %d, \"batches\": %ld, "
+                "\"dishes\": %ld, \"saved_minutes\": %ld},\n",
+                shm->config.batch_max, shm->config.batch_wait, shm->config.batch_extra,
+                atomic_load(&shm->stats.cooks.batches), atomic_load(&shm->stats.cooks.batched),
+                atomic_load(&shm->stats.cooks.batch_saved));
+    }
+    fprintf(out, "  \"utilization\": {\"cooks\": %.3f, \"waiters\": %.3f}\n",
+            (double)atomic_load(&shm->stats.cooks.busy) / ((long)shm->config.cooks * minutes),
+            (double)atomic_load(&shm->stats.waiters.busy) / ((long)shm->config.waiters * minutes));
+    fprintf(out, "}\n");
+    fclose(out);
+    
+    printf("Session statistics written to %s\n", path);
+}
+
+// Streaming reader over a memory-mapped trace, text (`id time size`, -1
+// terminated) or binary (gencustomers -B). Records are parsed into a small
+// lookahead ring while the feed waits for the next arrival, pages ahead of
+// the cursor are prefetched and pages behind it are dropped, so memory use
+// does not grow with the trace.
+#define TRACE_LOOKAHEAD 256          // Records parsed ahead of the arrival clock
+#define TRACE_WINDOW (1 << 20)       // Bytes prefetched ahead of / kept behind the cursor
+
+typedef struct {
+    const char *path;
+    const char *data;        // Whole file, mapped read-only
+    size_t size;
+    size_t pos;              // Parse cursor
+    size_t released;         // Bytes before this were handed back to the kernel
+    size_t prefetched;       // Bytes before this were requested with WILLNEED
+    int binary;
+    long line;               // Line (text) or record number (binary) at the cursor
+    int done;
+    const char *error;       // Why parsing stopped early, if it did
+    trace_record_t ahead[TRACE_LOOKAHEAD];
+    int head;
+    int count;
+} trace_reader_t;
+
+// Stop the trace at a bad record; the feed reports it once it has run the
+// records before it. Returns 0 so parsers can `return trace_error(...)`.
+static int trace_error(trace_reader_t *tr, const char *what) {
+    tr->error = what;
+    return 0;
+}
+
+static void trace_open(trace_reader_t *tr, const char *path) {
+    memset(tr, 0, sizeof(*tr));
+    tr->path = path;
+    tr->line = 1;
+    
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        perror("Error opening customers.txt");
+        exit(1);
+    }
+    tr->size = st.st_size;
+    if (tr->size == 0) {
+        tr->done = 1;
+        close(fd);
+        return;
+    }
+    
+    void *data = mmap(NULL, tr->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    close(fd);   // The mapping keeps the file; forked customers inherit no descriptor
+    tr->data = data;
+    madvise(data, tr->size, MADV_SEQUENTIAL);
+    
+    // Binary traces start with a header
+    const trace_header_t *header = (const trace_header_t *)tr->data;
+    if (tr->size >= sizeof(*header) && header->magic == TRACE_MAGIC) {
+        if (header->version != TRACE_VERSION) {
+            fprintf(stderr, "%s: unsupported binary trace version\n", path);
+            exit(1);
+        }
+        tr->binary = 1;
+        tr->pos = sizeof(*header);
+    }
+}
+
+// Keep a window of pages ahead of the cursor in flight and drop the ones
+// already parsed
+static void trace_window(trace_reader_t *tr) {
+    long page = sysconf(_SC_PAGESIZE);
+    
+    if (tr->prefetched < tr->size && tr->prefetched < tr->pos + TRACE_WINDOW / 2) {
+        size_t from = tr->prefetched & ~(page - 1);
+        size_t len = TRACE_WINDOW;
+        if (from + len > tr->size) len = tr->size - from;
+        madvise((char *)tr->data + from, len, MADV_WILLNEED);
+        tr->prefetched = from + len;
+    }
+    if (tr->pos > tr->released + 2 * TRACE_WINDOW) {
+        size_t upto = (tr->pos - TRACE_WINDOW) & ~(page - 1);
+        madvise((char *)tr->data + tr->released, upto - tr->released, MADV_DONTNEED);
+        tr->released = upto;
+    }
+}
+
+// Parse one non-negative decimal (or the -1 terminator) from [*p, end)
+static int parse_field(const char **p, const char *end, long *value) {
+    const char *c = *p;
+    while (c < end && (*c == ' ' || *c == '\t' || *c == '\r')) c++;
+    int negative = (c < end && *c == '-');
+    if (negative) c++;
+    if (c == end || *c < '0' || *c > '9') return 0;
+    
+    long v = 0;
+    while (c < end && *c >= '0' && *c <= '9') {
+        v = v * 10 + (*c++ - '0');
+        if (v > INT_MAX) return 0;
+    }
+    *value = negative ? -v : v;
+    *p = c;
+    return 1;
+}
+
+// Parse the next record at the cursor. Returns 0 at the end of the trace,
+// or at a bad record with tr->error set.
+static int trace_parse(trace_reader_t *tr, trace_record_t *rec) {
+    if (tr->binary) {
+        if (tr->pos == tr->size) return 0;
+        if (tr->size - tr->pos < sizeof(*rec)) return trace_error(tr, "truncated record");
+        memcpy(rec, tr->data + tr->pos, sizeof(*rec));
+        if (rec->id > INT_MAX || rec->arrival > INT_MAX || rec->party > INT_MAX) {
+            return trace_error(tr, "field out of range");
+        }
+        tr->pos += sizeof(*rec);
+        tr->line++;
+        return 1;
+    }
+    
+    while (tr->pos < tr->size) {
+        const char *start = tr->data + tr->pos;
+        const char *eol = memchr(start, '\n', tr->size - tr->pos);
+        const char *end = eol ? eol : tr->data + tr->size;
+        const char *c = start;
+        long id, arrival, party;
+        
+        // Skip blank lines
+        while (c < end && (*c == ' ' || *c == '\t' || *c == '\r')) c++;
+        if (c == end) {
+            tr->pos = (end - tr->data) + (eol != NULL);
+            tr->line++;
+            continue;
+        }
+        
+        if (!parse_field(&c, end, &id)) {
+            return trace_error(tr, "malformed record, expected `id time size`");
+        }
+        if (id == -1) return 0;
+        if (!parse_field(&c, end, &arrival) || !parse_field(&c, end, &party)) {
+            return trace_error(tr, "malformed record, expected `id time size`");
+        }
+        while (c < end && (*c == ' ' || *c == '\t' || *c == '\r')) c++;
+        if (c != end) return trace_error(tr, "trailing characters after record");
+        if (id < 0 || arrival < 0 || party < 0) return trace_error(tr, "negative field");
+        
+        rec->id = id;
+        rec->arrival = arrival;
+        rec->party = party;
+        tr->pos = (end - tr->data) + (eol != NULL);
+        tr->line++;
+        return 1;
+    }
+    return 0;
+}
+
+// Top up the lookahead ring; called while the feed has time to spare
+static void trace_fill(trace_reader_t *tr) {
+    while (!tr->done && tr->count < TRACE_LOOKAHEAD) {
+        trace_record_t *rec = &tr->ahead[(tr->head + tr->count) % TRACE_LOOKAHEAD];
+        if (!trace_parse(tr, rec)) {
+            tr->done = 1;
+            break;
+        }
+        tr->count++;
+    }
+    trace_window(tr);
+}
+
+static int trace_next(trace_reader_t *tr, trace_record_t *rec) {
+    if (tr->count == 0) trace_fill(tr);
+    if (tr->count == 0) return 0;
+    *rec = tr->ahead[tr->head];
+    tr->head = (tr->head + 1) % TRACE_LOOKAHEAD;
+    tr->count--;
+    return 1;
+}
+
+static void trace_close(trace_reader_t *tr) {
+    if (tr->data != NULL) munmap((void *)tr->data, tr->size);
+}
+
+// Event-driven customer engine (customer -e). Instead of a process per
+// customer, the feed seats arrivals itself and hands each seated customer
+// to the worker thread of its table. The worker places the order and blocks
+// on the seat semaphore, exactly as a forked customer does, so waiters and
+// cooks see the same protocol. Eating is a timed step: the worker puts the
+// customer on a timer wheel and goes back to waiting for its next guest,
+// and one timer thread frees tables as meals end. The thread count is
+// tables + 1 however many customers the trace holds.
+//
+// Virtual clock participants are threads, not customers: a thread takes
+// part while it has work, and whoever hands work to an idle thread joins
+// on its behalf first, as the fork path does for a child.
+#define WHEEL_SLOTS 64               // Minutes the wheel spans, more than EAT_MINUTES
+
+typedef struct {
+    shared_t *shm;
+    int semid;
+    pthread_mutex_t lock;
+    int seated;                      // Customers handed to workers and not yet gone
+    int closing;                     // Feed is done; idle threads exit
+    pthread_cond_t all_gone;
+    
+    // Per table: its worker and the guest waiting to be picked up
+    pthread_t *workers;
+    pthread_cond_t *guest_ready;
+    order_t *guests;
+    int *has_guest;
+    
+    // Timer wheel of eating customers. Slot (due % WHEEL_SLOTS) chains
+    // tables through wheel_next; entries never span more than the wheel
+    // because they are all due within EAT_MINUTES of the earliest.
+    pthread_t timer;
+    pthread_cond_t timer_wake;
+    int wheel_head[WHEEL_SLOTS];     // -1 if empty
+    int wheel_tail[WHEEL_SLOTS];
+    int *wheel_next;
+    order_t *eating;                 // Per table, with queued_at reused as the due minute
+    int cursor;                      // Earliest minute that can still be on the wheel
+    int timed;                       // Entries on the wheel
+    int timer_busy;                  // Timer thread is a clock participant
+} engine_t;
+
+static engine_t engine;
+
+// Called with engine.lock held
+static void wheel_add(const order_t *order, int due) {
+    engine_t *e = &engine;
+    int t = order->seat;
+    
+    if (e->timed == 0) e->cursor = due;
+    if (due - e->cursor >= WHEEL_SLOTS) {
+        fprintf(stderr, "timer wheel overflow (due %d, cursor %d)\n", due, e->cursor);
+        exit(1);
+    }
+    
+    e->eating[t] = *order;
+    e->eating[t].queued_at = due;
+    e->wheel_next[t] = -1;
+    int slot = due % WHEEL_SLOTS;
+    if (e->wheel_head[slot] == -1) e->wheel_head[slot] = t;
+    else e->wheel_next[e->wheel_tail[slot]] = t;
+    e->wheel_tail[slot] = t;
+    e->timed++;
+    
+    // Wake the timer, taking part in the clock on its behalf
+    if (!e->timer_busy) {
+        e->timer_busy = 1;
+        vclock_join(e->shm, e->semid);
+    }
+    pthread_cond_signal(&e->timer_wake);
+}
+
+static void *engine_timer(void *arg) {
+    engine_t *e = &engine;
+    shared_t *shm = e->shm;
+    
+    pthread_mutex_lock(&e->lock);
+    while (1) {
+        if (e->timed == 0) {
+            if (e->closing) break;
+            if (e->timer_busy) {
+                e->timer_busy = 0;
+                pthread_mutex_unlock(&e->lock);
+                vclock_leave(shm, e->semid);
+                pthread_mutex_lock(&e->lock);
+                continue;
+            }
+            pthread_cond_wait(&e->timer_wake, &e->lock);
+            continue;
+        }
+        
+        // The first non-empty slot from the cursor holds the next meal to end
+        int slot = e->cursor % WHEEL_SLOTS;
+        while (e->wheel_head[slot] == -1) {
+            e->cursor++;
+            slot = e->cursor % WHEEL_SLOTS;
+        }
+        int first = e->wheel_head[slot];
+        int due = e->eating[first].queued_at;
+        pthread_mutex_unlock(&e->lock);
+        
+        // New entries are due no earlier, so nothing can preempt this sleep.
+        // The timer has a semaphore of its own: a seat's would also carry
+        // the waiter's food-served wakeup for that table.
+        while (clock_now(shm) < due) {
+            update_time(shm, e->semid, MEAL_TIMER_SEM(shm), due - clock_now(shm));
+        }
+        
+        pthread_mutex_lock(&e->lock);
+        int t = e->wheel_head[slot];
+        e->wheel_head[slot] = -1;
+        while (t != -1) {
+            int next = e->wheel_next[t];
+            order_t order = e->eating[t];
+            e->timed--;
+            pthread_mutex_unlock(&e->lock);
+            leave_table(shm, e->semid, &order);
+            pthread_mutex_lock(&e->lock);
+            e->seated--;
+            t = next;
+        }
+        pthread_cond_signal(&e->all_gone);
+    }
+    pthread_mutex_unlock(&e->lock);
+    return NULL;
+}
+
+static void *engine_worker(void *arg) {
+    engine_t *e = &engine;
+    shared_t *shm = e->shm;
+    int t = (int)(intptr_t)arg;
+    
+    pthread_mutex_lock(&e->lock);
+    while (1) {
+        while (!e->has_guest[t] && !e->closing) {
+            pthread_cond_wait(&e->guest_ready[t], &e->lock);
+        }
+        if (!e->has_guest[t]) break;
+        order_t order = e->guests[t];
+        e->has_guest[t] = 0;
+        pthread_mutex_unlock(&e->lock);
+        
+        int served = place_order(shm, e->semid, &order);
+        if (served) {
+            wait_event(shm, e->semid, SEAT_SEM(shm, t));
+            food_served(shm, &order);
+        }
+        
+        pthread_mutex_lock(&e->lock);
+        if (served) {
+            wheel_add(&order, clock_now(shm) + EAT_MINUTES);
+        } else {
+            e->seated--;
+            pthread_cond_signal(&e->all_gone);
+        }
+        pthread_mutex_unlock(&e->lock);
+        
+        // Idle until the next guest is seated here
+        vclock_leave(shm, e->semid);
+        pthread_mutex_lock(&e->lock);
+    }
+    pthread_mutex_unlock(&e->lock);
+    return NULL;
+}
+
+static void engine_start(shared_t *shm, int semid) {
+    engine_t *e = &engine;
+    int tables = shm->config.tables;
+    
+    e->shm = shm;
+    e->semid = semid;
+    pthread_mutex_init(&e->lock, NULL);
+    pthread_cond_init(&e->all_gone, NULL);
+    pthread_cond_init(&e->timer_wake, NULL);
+    for (int i = 0; i < WHEEL_SLOTS; i++) {
+        e->wheel_head[i] = -1;
+    }
+    
+    e->workers = calloc(tables, sizeof(pthread_t));
+    e->guest_ready = calloc(tables, sizeof(pthread_cond_t));
+    e->guests = calloc(tables, sizeof(order_t));
+    e->has_guest = calloc(tables, sizeof(int));
+    e->wheel_next = calloc(tables, sizeof(int));
+    e->eating = calloc(tables, sizeof(order_t));
+    if (!e->workers || !e->guest_ready || !e->guests || !e->has_guest ||
+        !e->wheel_next || !e->eating) {
+        perror("calloc");
+        exit(1);
+    }
+    
+    for (int t = 0; t < tables; t++) {
+        pthread_cond_init(&e->guest_ready[t], NULL);
+        if (pthread_create(&e->workers[t], NULL, engine_worker, (void *)(intptr_t)t) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    if (pthread_create(&e->timer, NULL, engine_timer, NULL) != 0) {
+        perror("pthread_create");
+        exit(1);
+    }
+}
+
+// Seat an arrival from the feed and hand it to its table's worker
+static void engine_arrive(const trace_record_t *rec) {
+    engine_t *e = &engine;
+    order_t order;
+    
+    if (!seat_customer(e->shm, e->semid, rec->id, rec->arrival, rec->party, &order)) {
+        return;
+    }
+    
+    pthread_mutex_lock(&e->lock);
+    vclock_join(e->shm, e->semid);
+    e->guests[order.seat] = order;
+    e->has_guest[order.seat] = 1;
+    e->seated++;
+    pthread_cond_signal(&e->guest_ready[order.seat]);
+    pthread_mutex_unlock(&e->lock);
+}
+
+// Wait for every seated customer to leave, then stop the threads. The feed
+// must already have left the virtual clock.
+static void engine_finish(void) {
+    engine_t *e = &engine;
+    
+    pthread_mutex_lock(&e->lock);
+    while (e->seated > 0) {
+        pthread_cond_wait(&e->all_gone, &e->lock);
+    }
+    e->closing = 1;
+    for (int t = 0; t < e->shm->config.tables; t++) {
+        pthread_cond_signal(&e->guest_ready[t]);
+    }
+    pthread_cond_signal(&e->timer_wake);
+    pthread_mutex_unlock(&e->lock);
+    
+    for (int t = 0; t < e->shm->config.tables; t++) {
+        pthread_join(e->workers[t], NULL);
+    }
+    pthread_join(e->timer, NULL);
+}
+
+int main(int argc, char *argv[]) {
+    trace_reader_t trace;
+    trace_record_t rec;
+    const char *stats_path = "stats.json";
+    int event_driven = 0;
+    
+    int opt;
+    while ((opt = getopt(argc, argv, "eo:N:")) != -1) {
+        switch (opt) {
+        case 'e': event_driven = 1; break;      // Worker threads instead of a process per customer
+        case 'o': stats_path = optarg; break;   // Where to export session statistics
+        case 'N': set_instance(optarg); break;  // Session to join
+        default:
+            fprintf(stderr, "Usage: %s [-e] [-o stats.json] [-N instance]\n", argv[0]);
+            exit(1);
+        }
+    }
     
     printf("Customer processes starting...\n");
     
@@ -92,75 +668,118 @@ int main() {
         exit(1);
     }
     
-    int semid = semget(key, TOTAL_SEMS, 0666);
-    if (semid == -1) {
-        perror("semget in customer");
-        exit(1);
-    }
+    shared_t *shm = attach_shared_memory(shmid);
     
-    // Open customer input file
-    fp = fopen("customers.txt", "r");
-    if (fp == NULL) {
-        perror("Error opening customers.txt");
+    // Replay orders sections per customer; the engine's shared timer
+    // thread would have to leave tables in exactly the recorded order
+    if (event_driven && shm->config.decisions != DECISIONS_OFF) {
+        fprintf(stderr, "Decision record/replay needs a process per customer; drop -e\n");
         exit(1);
     }
     
-    // Array to store child PIDs
-    pid_t *child_pids = malloc(MAX_CUSTOMERS * sizeof(pid_t));
-    if (child_pids == NULL) {
-        perror("malloc");
+    int semid = semset_get(0, 0666);
+    if (semid == -1) {
+        perror("semget in customer");
         exit(1);
     }
     
+    // Open customer input file. Only open errors end the process here; a
+    // bad record later stops the feed, and the session winds down normally.
+    trace_open(&trace, "customers.txt");
+    
+    // The arrival feed is itself a participant of the virtual clock
+    vclock_join(shm, semid);
+    
+    // Customers still running; finished ones are reaped as we go
     int customer_count = 0;
     
+    if (event_driven) {
+        engine_start(shm, semid);
+    }
+    
+    // On the wall clock, arrivals are due at fixed offsets from the start
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
     // Read customer data and create processes
-    while (fscanf(fp, "%d %d %d", &customer_id, &arrival_time, &party_size) == 3) {
-        if (customer_id == -1) break;
-        if(customer_id < 0 || arrival_time < 0 || party_size < 0) {
-            exit(1);
+    while (trace_next(&trace, &rec)) {
+        int arrival_time = rec.arrival;
+        
+        // Parse ahead while there is time before this arrival
+        trace_fill(&trace);
+        
+        // Wait for the arrival. The wall-clock deadline is absolute, so the
+        // time spent parsing and forking never pushes later arrivals back.
+        if (VCLOCK_ENABLED(shm)) {
+            vclock_sleep_until(shm, semid, ARRIVAL_TIMER_SEM(shm), arrival_time);
+        } else {
+            long long ns = start.tv_nsec + arrival_time * 100000000LL;   // Scale: 1 minute = 100ms
+            struct timespec due = { start.tv_sec + ns / 1000000000, ns % 1000000000 };
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) == EINTR) {
+            }
         }
-
         
-        // Wait for the time difference between consecutive customers
-        if (arrival_time > prev_arrival_time) {
-            usleep((arrival_time - prev_arrival_time) * 100000); // Scale: 1 minute = 100ms
+        if (event_driven) {
+            engine_arrive(&rec);
+            continue;
         }
-        prev_arrival_time = arrival_time;
         
         // Fork a child process for the customer
-        child_pids[customer_count] = fork();
+        vclock_join(shm, semid);
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == -1) {
+            perror("fork");
+            exit(1);
+        }
         
-        if (child_pids[customer_count] == 0) {
+        if (pid == 0) {
             // Child process - customer
-            cmain(customer_id, arrival_time, party_size, shmid, semid);
+            cmain(rec.id, arrival_time, rec.party, shmid, semid);
             // Should not reach here as cmain calls exit()
             exit(0);
         }
         
         customer_count++;
+        while (waitpid(-1, NULL, WNOHANG) > 0) {
+            customer_count--;
+        }
     }
     
-    fclose(fp);
+    if (trace.error) {
+        fprintf(stderr, "%s:%ld: %s; no further customers\n", trace.path, trace.line, trace.error);
+    }
+    trace_close(&trace);
+    vclock_leave(shm, semid);
+    if (event_driven) {
+        engine_finish();
+    }
+    shmdt(shm);
     
     // Wait for all customer processes to finish
-    for (int i = 0; i < customer_count; i++) {
-        waitpid(child_pids[i], NULL, 0);
+    while (customer_count > 0 && wait(NULL) > 0) {
+        customer_count--;
     }
     
     printf("All customers have finished. Cleaning up IPC resources.\n");
     
+    // Report how the session's waiter and kitchen policies performed
+    shm = attach_shared_memory(shmid);
+    print_session_stats(shm);
+    write_session_json(shm, stats_path);
+    shmdt(shm);
+    
     // Clean up IPC resources
     if (shmctl(shmid, IPC_RMID, NULL) == -1) {
         perror("shmctl");
     }
     
-    if (semctl(semid, 0, IPC_RMID) == -1) {
+    if (semset_remove(semid) == -1) {
         perror("semctl");
     }
+    telemetry_remove();
     
-    free(child_pids);
     printf("Restaurant simulation completed.\n");
     
-    return 0;
+    return trace.error ? 1 : 0;
 }
\ No newline at end of file
@@ -0,0 +1,128 @@
+#ifndef DECISIONS_H
+#define DECISIONS_H
+
+#include "ipc_shared.h"
+
+// Record/replay of synchronization decisions (cook -R / -P). Every step
+// where scheduling decides the outcome (a seat grant, which order a cook
+// or waiter dequeues, whether a queue had room) runs as a numbered section.
+// Recording serializes the sections with a ticket lock and logs who ran
+// each one; replay makes each section wait until the log says it is its
+// turn, so two builds see the same interleaving. Sections never block, so
+// the turnstile cannot deadlock.
+#define DECISION_MAGIC 0x43444453   // "SDDC"
+#define DECISION_VERSION 4
+#define DECISION_CAPACITY (1 << 20) // Records kept when recording
+#define DECISION_STALL_SECONDS 10   // Replay gives up if no section runs for this long
+
+// Header of a decision file, followed by count decision_t records
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    config_t config;         // Replay runs with the recorded staffing and policies
+    uint32_t fast_forward;
+    uint32_t truncated;
+    uint64_t count;
+} decision_file_header_t;
+
+// Actors, numbered cooks first, then waiters, then customers
+#define DECISION_COOK(c) (c)
+#define DECISION_WAITER(shm, w) ((shm)->config.cooks + (w))
+#define DECISION_CUSTOMER(shm, id) ((shm)->config.cooks + (shm)->config.waiters + (id))
+
+// Start a decision section. Recording queues for the next ticket; replay
+// waits, off the virtual clock, until the log reaches a section of this
+// kind by this actor. Returns the actor to run as: any idle cook may be
+// woken for a recorded cook-take, so on replay it adopts the recorded id.
+static inline int decision_begin(shared_t *shm, int semid, int actor, int kind) {
+    int mode = shm->config.decisions;
+    if (mode == DECISIONS_OFF) return actor;
+    decision_log_t *log = DECISION_LOG(shm);
+    
+    if (mode == DECISIONS_RECORD) {
+        unsigned long ticket = atomic_fetch_add(&log->next_ticket, 1);
+        while (atomic_load(&log->turn) != ticket) {
+            sched_yield();
+        }
+        if (ticket < (unsigned long)shm->config.decision_capacity) {
+            decision_t d = { actor, kind, clock_now(shm), 0 };
+            log->records[ticket] = d;
+        } else {
+            atomic_store(&log->overflow, 1);
+        }
+        return actor;
+    }
+    
+    int parked = 0;
+    unsigned long turn, seen = ULONG_MAX;
+    struct timespec since, now;
+    while (1) {
+        turn = atomic_load(&log->turn);
+        unsigned long claim = turn;
+        if (turn >= log->count) {
+            // Past the end of the recording: just serialize
+            if (atomic_compare_exchange_strong(&log->next_ticket, &claim, turn + 1)) break;
+        } else {
+            decision_t *d = &log->records[turn];
+            int mine = d->kind == kind &&
+                       (d->actor == (uint32_t)actor ||
+                        (kind == DECISION_COOK_TAKE && d->actor < (uint32_t)shm->config.cooks));
+            if (mine && atomic_compare_exchange_strong(&log->next_ticket, &claim, turn + 1)) {
+                actor = d->actor;
+                break;
+            }
+        }
+        if (atomic_load(&log->diverged)) {
+            exit(1);   // Another role reported the divergence
+        }
+        
+        // Not our turn: stop holding back the virtual clock while we wait
+        if (!parked && VCLOCK_ENABLED(shm)) {
+            atomic_fetch_add(&log->parked, 1);
+            take_lock(semid, CLOCK_SEM);
+            VCLOCK(shm)->runnable--;
+            vclock_advance(shm, semid);
+            put(semid, CLOCK_SEM);
+            parked = 1;
+        }
+        
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (turn != seen) {
+            seen = turn;
+            since = now;
+        } else if (now.tv_sec - since.tv_sec > DECISION_STALL_SECONDS) {
+            decision_diverged(shm, semid, turn, "no role reached this decision");
+        }
+        sched_yield();
+    }
+    
+    if (parked) {
+        take_lock(semid, CLOCK_SEM);
+        VCLOCK(shm)->runnable++;
+        put(semid, CLOCK_SEM);
+        atomic_fetch_sub(&log->parked, 1);
+    }
+    if (turn < log->count && VCLOCK_ENABLED(shm) && clock_now(shm) != log->records[turn].minute) {
+        decision_diverged(shm, semid, turn, "reached at a different minute");
+    }
+    return actor;
+}
+
+// Finish the current section with its outcome and pass the turn on
+static inline void decision_end(shared_t *shm, int semid, int value) {
+    int mode = shm->config.decisions;
+    if (mode == DECISIONS_OFF) return;
+    decision_log_t *log = DECISION_LOG(shm);
+    
+    unsigned long turn = atomic_load(&log->turn);
+    if (mode == DECISIONS_RECORD) {
+        if (turn < (unsigned long)shm->config.decision_capacity) {
+            log->records[turn].value = value;
+        }
+    } else if (turn < log->count && log->records[turn].value != value) {
+        decision_diverged(shm, semid, turn, "different outcome");
+    }
+    atomic_store(&log->turn, turn + 1);
+}
+
+#endif // DECISIONS_H
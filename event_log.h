@@ -0,0 +1,212 @@
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include "ipc_base.h"
+#include "menu.h"
+
+// Event log (cook -l). Roles push fixed-size records into lock-free rings
+// in shared memory instead of calling printf; a logger process drains them
+// to a file and `eventlog` prints them in the usual text form. Each cook
+// and waiter process has its own ring; customers share one multi-producer
+// ring. A full ring drops the event and counts it rather than blocking.
+#define EVENT_RING_SIZE 8192     // Per ring, a power of two
+#define EVENT_MAGIC 0x56454453   // "SDEV"
+#define EVENT_VERSION 3
+
+enum {
+    EV_COOK_STARTED = 0,      // a = pid
+    EV_COOK_PREPARING,        // a = customer, b = party, c = waiter
+    EV_COOK_FINISHED,         // a = customer
+    EV_COOK_LAST,
+    EV_COOK_DISH,             // a = customer, b = dish, c = station kind
+    EV_COOK_PLATING,          // a = customer, b = party, c = waiter
+    EV_COOK_BATCH,            // a = dish, b = portions, c = minutes
+    EV_COOK_TERMINATED,
+    EV_WAITER_STARTED,        // a = pid
+    EV_WAITER_TAKING,         // a = customer, b = party, c = stolen
+    EV_WAITER_KITCHEN_FULL,
+    EV_WAITER_SUBMITTED,      // a = customer
+    EV_WAITER_SERVING,        // a = customer
+    EV_WAITER_TERMINATED,
+    EV_CUSTOMER_ARRIVED,      // a = customer, b = party, c = arrival minute
+    EV_CUSTOMER_CLOSED,       // a = customer
+    EV_CUSTOMER_NO_TABLE,     // a = customer
+    EV_CUSTOMER_SEATED,       // a = customer, b = tables remaining
+    EV_CUSTOMER_QUEUE_FULL,   // a = customer, b = waiter
+    EV_CUSTOMER_ASSIGNED,     // a = customer, b = waiter
+    EV_CUSTOMER_EATING,       // a = customer
+    EV_CUSTOMER_LEFT,         // a = customer, b = tables available
+    EV_DROPPED,               // a = events lost to full rings (written by the logger)
+    NUM_EVENTS
+};
+
+typedef struct {
+    uint64_t ns;         // CLOCK_MONOTONIC, orders events across rings
+    int32_t minute;      // Simulated time
+    uint16_t type;       // EV_*
+    uint16_t role;       // Cook or waiter id
+    int32_t a, b, c;
+    int32_t reserved;
+} event_t;
+
+typedef struct {
+    _Atomic unsigned seq;
+    event_t event;
+} event_slot_t;
+
+// Same sequence protocol as order_ring_t (ipc_shared.h), with a single consumer
+typedef struct {
+    unsigned mask CACHE_ALIGNED;
+    _Atomic unsigned head CACHE_ALIGNED;
+    _Atomic unsigned tail CACHE_ALIGNED;
+    _Atomic unsigned dropped;
+    event_slot_t slots[] CACHE_ALIGNED;
+} event_ring_t;
+
+#define EVENT_RING_BYTES ALIGN_UP(sizeof(event_ring_t) + EVENT_RING_SIZE * sizeof(event_slot_t))
+
+// Header of the file the logger writes, followed by event_t records
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t reserved;
+} event_file_header_t;
+
+static inline void event_ring_init(event_ring_t *ring) {
+    ring->mask = EVENT_RING_SIZE - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->dropped, 0);
+    for (unsigned i = 0; i < EVENT_RING_SIZE; i++) {
+        atomic_init(&ring->slots[i].seq, i);
+    }
+}
+
+// Multi-producer enqueue; a full ring counts the event as dropped
+static inline void event_push(event_ring_t *ring, const event_t *event) {
+    unsigned pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    event_slot_t *slot;
+    
+    while (1) {
+        slot = &ring->slots[pos & ring->mask];
+        unsigned seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        int dif = (int)(seq - pos);
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring->tail, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (dif < 0) {
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            return;
+        } else {
+            pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        }
+    }
+    
+    slot->event = *event;
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+}
+
+// Single-consumer dequeue, used by the logger
+static inline int event_pop(event_ring_t *ring, event_t *event) {
+    unsigned pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    event_slot_t *slot = &ring->slots[pos & ring->mask];
+    
+    if (atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + 1) {
+        return 0;
+    }
+    *event = slot->event;
+    atomic_store_explicit(&ring->head, pos + 1, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, pos + ring->mask + 1, memory_order_release);
+    return 1;
+}
+
+// Render an event as the line the roles used to print (without newline)
+static inline void format_event(const event_t *ev, char *buf, size_t len) {
+    char who[16];
+    
+    switch (ev->type) {
+    case EV_COOK_STARTED:
+        snprintf(buf, len, "Cook %s started (PID: %d)", cook_name(ev->role), ev->a);
+        break;
+    case EV_COOK_PREPARING:
+        snprintf(who, sizeof(who), "%s", waiter_name(ev->c));
+        snprintf(buf, len, "Cook %s preparing food for customer %d (party size: %d, waiter: %s)",
+                 cook_name(ev->role), ev->a, ev->b, who);
+        break;
+    case EV_COOK_FINISHED:
+        snprintf(buf, len, "Cook %s finished preparing food for customer %d", cook_name(ev->role), ev->a);
+        break;
+    case EV_COOK_LAST:
+        snprintf(buf, len, "Cook %s is the last cook, waking all waiters to end session", cook_name(ev->role));
+        break;
+    case EV_COOK_DISH:
+        snprintf(buf, len, "Cook %s at the %s station preparing %s for customer %d",
+                 cook_name(ev->role), station_kind_names[ev->c], menu[ev->b].name, ev->a);
+        break;
+    case EV_COOK_PLATING:
+        snprintf(who, sizeof(who), "%s", waiter_name(ev->c));
+        snprintf(buf, len, "Cook %s plating the order for customer %d (party size: %d, waiter: %s)",
+                 cook_name(ev->role), ev->a, ev->b, who);
+        break;
+    case EV_COOK_BATCH:
+        snprintf(buf, len, "Cook %s making %d portions of %s together in %d minutes",
+                 cook_name(ev->role), ev->b, menu[ev->a].name, ev->c);
+        break;
+    case EV_COOK_TERMINATED:
+        snprintf(buf, len, "Cook %s terminated", cook_name(ev->role));
+        break;
+    case EV_WAITER_STARTED:
+        snprintf(buf, len, "Waiter %s started (PID: %d)", waiter_name(ev->role), ev->a);
+        break;
+    case EV_WAITER_TAKING:
+        snprintf(buf, len, "Waiter %s taking order from customer %d (party size: %d)%s",
+                 waiter_name(ev->role), ev->a, ev->b, ev->c ? " [stolen]" : "");
+        break;
+    case EV_WAITER_KITCHEN_FULL:
+        snprintf(buf, len, "Waiter %s found the kitchen queue full, waiting for room", waiter_name(ev->role));
+        break;
+    case EV_WAITER_SUBMITTED:
+        snprintf(buf, len, "Waiter %s submitted order for customer %d to kitchen", waiter_name(ev->role), ev->a);
+        break;
+    case EV_WAITER_SERVING:
+        snprintf(buf, len, "Waiter %s serving food to customer %d", waiter_name(ev->role), ev->a);
+        break;
+    case EV_WAITER_TERMINATED:
+        snprintf(buf, len, "Waiter %s terminated", waiter_name(ev->role));
+        break;
+    case EV_CUSTOMER_ARRIVED:
+        snprintf(buf, len, "Customer %d (party size: %d) arrived at %d minutes after 11:00am", ev->a, ev->b, ev->c);
+        break;
+    case EV_CUSTOMER_CLOSED:
+        snprintf(buf, len, "Customer %d arrived after closing time and left", ev->a);
+        break;
+    case EV_CUSTOMER_NO_TABLE:
+        snprintf(buf, len, "Customer %d couldn't find an empty table and left", ev->a);
+        break;
+    case EV_CUSTOMER_SEATED:
+        snprintf(buf, len, "Customer %d occupied a table (%d tables remaining)", ev->a, ev->b);
+        break;
+    case EV_CUSTOMER_QUEUE_FULL:
+        snprintf(buf, len, "Customer %d found waiter %s's queue full and left", ev->a, waiter_name(ev->b));
+        break;
+    case EV_CUSTOMER_ASSIGNED:
+        snprintf(buf, len, "Customer %d is assigned to waiter %s", ev->a, waiter_name(ev->b));
+        break;
+    case EV_CUSTOMER_EATING:
+        snprintf(buf, len, "Customer %d received food and is eating", ev->a);
+        break;
+    case EV_CUSTOMER_LEFT:
+        snprintf(buf, len, "Customer %d finished eating and left (%d tables now available)", ev->a, ev->b);
+        break;
+    case EV_DROPPED:
+        snprintf(buf, len, "(%d events dropped: event rings were full)", ev->a);
+        break;
+    default:
+        snprintf(buf, len, "(unknown event %d)", ev->type);
+        break;
+    }
+}
+
+#endif // EVENT_LOG_H
@@ -0,0 +1,73 @@
+#include "event_log.h"
+
+// Decoder for the binary event log written by `cook -l`. Events from all
+// rings are merged by timestamp and printed in the roles' usual text form;
+// -m prefixes each line with the simulated minute.
+
+static int by_time(const void *x, const void *y) {
+    const event_t *a = x, *b = y;
+    return (a->ns > b->ns) - (a->ns < b->ns);
+}
+
+int main(int argc, char *argv[]) {
+    int minutes = 0;
+    
+    int opt;
+    while ((opt = getopt(argc, argv, "m")) != -1) {
+        switch (opt) {
+        case 'm': minutes = 1; break;
+        default:
+            fprintf(stderr, "Usage: %s [-m] event_log\n", argv[0]);
+            exit(1);
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "Usage: %s [-m] event_log\n", argv[0]);
+        exit(1);
+    }
+    
+    FILE *in = fopen(argv[optind], "r");
+    if (in == NULL) {
+        perror("Error opening event log");
+        exit(1);
+    }
+    
+    event_file_header_t header;
+    if (fread(&header, sizeof(header), 1, in) != 1 || header.magic != EVENT_MAGIC ||
+        header.version != EVENT_VERSION || header.record_size != sizeof(event_t)) {
+        fprintf(stderr, "%s: not an event log of this version\n", argv[optind]);
+        exit(1);
+    }
+    
+    // Load every record, growing the buffer geometrically
+    size_t count = 0, capacity = 1 << 16;
+    event_t *events = malloc(capacity * sizeof(event_t));
+    if (events == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    while (fread(&events[count], sizeof(event_t), 1, in) == 1) {
+        if (++count == capacity) {
+            capacity *= 2;
+            events = realloc(events, capacity * sizeof(event_t));
+            if (events == NULL) {
+                perror("realloc");
+                exit(1);
+            }
+        }
+    }
+    fclose(in);
+    
+    // The logger writes ring by ring; restore the global order
+    qsort(events, count, sizeof(event_t), by_time);
+    
+    char line[128];
+    for (size_t i = 0; i < count; i++) {
+        format_event(&events[i], line, sizeof(line));
+        if (minutes && events[i].type != EV_DROPPED) printf("[%3d] ", events[i].minute);
+        puts(line);
+    }
+    
+    free(events);
+    return 0;
+}
@@ -3,6 +3,8 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
 
 // Semaphore structure
 typedef struct {
@@ -30,34 +32,153 @@ void V(semaphore *s) {
 // Shared data
 int leftvisitors;
 int m, n;
-bool *BA; // boat available
-int *BC, *BT; // boat capacity, boat time
-semaphore boat, rider;
+int workers; // 0: a thread per visitor and per boat
+int capacity = 1; // Seats per boat
+int max_wait = 10; // Minutes a part-filled boat waits before leaving
+int minute_us = 100000; // Wall-clock length of a park minute
+int *BN, *BR, *BT, *BG; // riders aboard, their ids (capacity per boat), ride time, rides finished
+double *BF; // minute the first rider boarded
+int *VT, *VG; // visitor ride time, boat ride the visitor boarded
+double *VR; // minute the visitor was ready to ride
 pthread_mutex_t bmtx;
-pthread_barrier_t EOS, *BB;
+pthread_barrier_t EOS;
+pthread_cond_t *BFULL, *BGO; // riders boarded, ride over
+struct timespec park_start;
+
+// Boat dispatch, all under bmtx. At most one boat takes riders at a time.
+// A ready visitor joins it, starts boarding a boat from the free stack, or
+// queues; a boat back at the dock boards the longest-waiting visitors in one
+// batch and otherwise goes onto the free stack. Each step is O(capacity).
+int loading = -1; // boat taking riders
+int *FB, nfree; // free boat stack
+int *WQ, whead, wtail; // waiting visitor queue (each visitor queues once)
+int *VB; // boat handed to each waiting visitor
+semaphore *VS; // one per visitor
+
+// Ride statistics, under bmtx
+long rides, seats_taken;
+double ride_minutes, queue_minutes;
+
+double park_time() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double us = (now.tv_sec - park_start.tv_sec) * 1e6 + (now.tv_nsec - park_start.tv_nsec) / 1e3;
+    return us / minute_us;
+}
+
+struct timespec park_deadline(double minute) {
+    long us = minute * minute_us;
+    struct timespec deadline = park_start;
+    deadline.tv_sec += us / 1000000;
+    deadline.tv_nsec += (us % 1000000) * 1000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    return deadline;
+}
+
+// Condition variables time out on the monotonic park clock
+void init_cond(pthread_cond_t *cv) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cv, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+// Seat a visitor; a full boat stops taking riders. The ride lasts as long
+// as the longest ride wanted on board.
+void add_rider(int id, int visitor) {
+    BR[id * capacity + BN[id]++] = visitor;
+    VG[visitor] = BG[id];
+    if (BN[id] == 1) {
+        BF[id] = park_time();
+        BT[id] = VT[visitor];
+    } else if (VT[visitor] > BT[id]) {
+        BT[id] = VT[visitor];
+    }
+    printf("Visitor %d Finds boat %d\n", visitor+1, id+1);
+    if (BN[id] == capacity && loading == id) loading = -1;
+}
+
+// Returns the boat the visitor boarded, or -1 when it has to queue
+int board(int visitor) {
+    int id = loading;
+    if (id == -1) {
+        if (nfree == 0) {
+            WQ[wtail++] = visitor;
+            return -1;
+        }
+        id = loading = FB[--nfree];
+    }
+    add_rider(id, visitor);
+    return id;
+}
+
+// Returns how many waiting visitors the boat took
+int dock_boat(int id) {
+    BN[id] = 0;
+    int taken = 0;
+    while (whead != wtail && taken < capacity) {
+        int visitor = WQ[whead++];
+        add_rider(id, visitor);
+        if (workers == 0) {
+            VB[visitor] = id;
+            V(&VS[visitor]);
+        }
+        taken++;
+    }
+    if (taken == 0) FB[nfree++] = id;
+    else if (taken < capacity) loading = id;
+    return taken;
+}
+
+// Close boarding and account for the ride
+void depart(int id) {
+    if (loading == id) loading = -1;
+    double now = park_time();
+    for (int i = 0; i < BN[id]; i++) {
+        int visitor = BR[id * capacity + i];
+        queue_minutes += now - VR[visitor];
+    }
+    rides++;
+    seats_taken += BN[id];
+    ride_minutes += BT[id];
+}
 
 void *boat_thread(void *arg) {
     int id = *(int *)arg;
+    int riders[capacity];
     printf("Boat %d Ready\n", id+1);
     while (1) {
-        V(&rider);
-        P(&boat);
         pthread_mutex_lock(&bmtx);
-        BA[id] = true;
-        BC[id] = -1;
-        pthread_mutex_unlock(&bmtx);
-        pthread_barrier_wait(&BB[id]);
-        pthread_mutex_lock(&bmtx);
-        int visitor = BC[id];
+        dock_boat(id);
+        while (BN[id] == 0 && leftvisitors > 0)
+            pthread_cond_wait(&BFULL[id], &bmtx);
+        if (BN[id] == 0) { // Park closed
+            pthread_mutex_unlock(&bmtx);
+            break;
+        }
+        struct timespec deadline = park_deadline(BF[id] + max_wait);
+        while (BN[id] < capacity && park_time() < BF[id] + max_wait)
+            pthread_cond_timedwait(&BFULL[id], &bmtx, &deadline);
+        depart(id);
+        int count = BN[id];
         int rtime = BT[id];
-        BA[id] = false;
+        for (int i = 0; i < count; i++) riders[i] = BR[id * capacity + i];
         pthread_mutex_unlock(&bmtx);
-        printf("Boat %d Start of ride for visitor %d\n", id+1, visitor+1);
-        usleep(rtime * 100000);
-        printf("Boat %d End of ride for visitor %d (ride time = %d)\n", id+1, visitor+1,rtime);
+        for (int i = 0; i < count; i++)
+            printf("Boat %d Start of ride for visitor %d\n", id+1, riders[i]+1);
+        usleep(rtime * minute_us);
+        for (int i = 0; i < count; i++)
+            printf("Boat %d End of ride for visitor %d (ride time = %d)\n", id+1, riders[i]+1, rtime);
         pthread_mutex_lock(&bmtx);
-        leftvisitors--;
+        BG[id]++;
+        pthread_cond_broadcast(&BGO[id]); // All riders leave the boat at once
+        leftvisitors -= count;
         if(leftvisitors == 0) {
+            for (int i = 0; i < m; i++) pthread_cond_signal(&BFULL[i]);
             pthread_mutex_unlock(&bmtx);
             pthread_barrier_wait(&EOS);
             break;
@@ -72,60 +193,44 @@ void *visitor_thread(void *arg) {
     int vtime = rand() % 91 + 30;
     int rtime = rand() % 46 + 15;
     printf("Visitor %d Starts sightseeing for %d minutes\n", id+1, vtime);
-    usleep(vtime * 100000);
+    usleep(vtime * minute_us);
     printf("Visitor %d Ready to ride a boat (ride time = %d)\n", id+1, rtime);
-    V(&boat);
-    P(&rider);
-    int found_boat = -1;
-    while (found_boat == -1) {
-        pthread_mutex_lock(&bmtx);
-        for (int i = 0; i < m; i++) {
-            if (BA[i] && BC[i] == -1) {
-                BC[i] = id;
-                BT[i] = rtime;
-                found_boat = i;
-                break;
-            }
-        }
-        pthread_mutex_unlock(&bmtx);
-        if (found_boat == -1)
-            usleep(10000);
+    pthread_mutex_lock(&bmtx);
+    VT[id] = rtime;
+    VR[id] = park_time();
+    int found_boat = board(id);
+    if (found_boat >= 0) pthread_cond_signal(&BFULL[found_boat]);
+    pthread_mutex_unlock(&bmtx);
+    if (found_boat == -1) {
+        P(&VS[id]);
+        found_boat = VB[id]; // Written before the V that woke us
     }
-    printf("Visitor %d Finds boat %d\n", id+1, found_boat+ 1);
-    pthread_barrier_wait(&BB[found_boat]);
-    usleep(rtime * 100000);
+    // The ride lasts as long as the boat's, so wait for the boat to end it
+    pthread_mutex_lock(&bmtx);
+    while (BG[found_boat] == VG[id])
+        pthread_cond_wait(&BGO[found_boat], &bmtx);
+    pthread_mutex_unlock(&bmtx);
     printf("Visitor %d Leaving \n", id+1);
     return NULL;
 }
 
-int main(int argc, char *argv[]) {
-    if (argc != 3) {
-        fprintf(stderr, "Usage: %s <boats> <visitors>\n", argv[0]);
-        exit(1);
-    }
-    
-    m = atoi(argv[1]);
-    n = atoi(argv[2]);
-
-    leftvisitors = n;
-    
+void run_threads() {
     pthread_t boat_threads[m], visitor_threads[n];
     int boat_ids[m], visitor_ids[n];
     
-    boat = (semaphore){0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
-    rider = (semaphore){0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
-    pthread_mutex_init(&bmtx, NULL);
     pthread_barrier_init(&EOS, NULL, 2);
+    VB = malloc(n * sizeof(int));
+    VS = malloc(n * sizeof(semaphore));
+    BFULL = malloc(m * sizeof(pthread_cond_t));
+    BGO = malloc(m * sizeof(pthread_cond_t));
     
-    BA = calloc(m, sizeof(bool));
-    BC = calloc(m, sizeof(int));
-    BT = calloc(m, sizeof(int));
-    BB = malloc(m * sizeof(pthread_barrier_t));
+    for (int i = 0; i < n; i++) {
+        VS[i] = (semaphore){0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+    }
     
     for (int i = 0; i < m; i++) {
-        BA[i] = false;
-        BC[i] = -1;
-        pthread_barrier_init(&BB[i], NULL, 2);
+        init_cond(&BFULL[i]);
+        pthread_cond_init(&BGO[i], NULL);
     }
     
     for (int i = 0; i < m; i++) {
@@ -141,13 +246,385 @@ int main(int argc, char *argv[]) {
     pthread_barrier_wait(&EOS);
     printf("All visitors have left\n");
     for (int i = 0; i < n; i++) pthread_join(visitor_threads[i], NULL);
-    for (int i = 0; i < m; i++) pthread_cancel(boat_threads[i]);
+    for (int i = 0; i < m; i++) pthread_join(boat_threads[i], NULL);
     
-    free(BA);
-    free(BC);
+    free(VB);
+    free(VS);
+    free(BFULL);
+    free(BGO);
+    pthread_barrier_destroy(&EOS);
+}
+
+// Pool mode: a fixed set of worker threads runs visitors and boats as small
+// state machines. Sightseeing and rides are timers on a shared wheel with
+// one slot per park minute; a worker that finds the wheel behind the clock
+// moves the expired tasks onto its own run queue, and idle workers steal
+// from the others. Output is the same as with a thread per visitor.
+
+enum { VISITOR_START, VISITOR_READY, VISITOR_LEAVE };   // Visitor states
+enum { BOAT_START, BOAT_END };                          // Boat states
+
+typedef struct task {
+    struct task *next, *prev; // prev only on the wheel
+    bool boat;
+    int id;
+    int state;
+    int vtime; // Visitor
+    bool waiting; // Boat: boarding timeout set
+    bool armed; // On the wheel
+    int slot;
+} task_t;
+
+// Longer than any sightseeing or ride time, so each slot holds one lap
+#define WHEEL_SLOTS 128
+
+typedef struct {
+    pthread_mutex_t mtx;
+    task_t *head, *tail;
+    atomic_int count; // Peeked at without the lock by thieves
+} runqueue_t;
+
+task_t *visitor_tasks, *boat_tasks;
+runqueue_t *runqueues;
+
+pthread_mutex_t wheel_mtx = PTHREAD_MUTEX_INITIALIZER;
+task_t *wheel[WHEEL_SLOTS];
+_Atomic long wheel_tick; // Last minute whose timers have fired
+
+pthread_mutex_t idle_mtx = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t idle_cv = PTHREAD_COND_INITIALIZER;
+atomic_int ready_tasks, sleepers, park_closed;
+
+void wake_idle() {
+    if (atomic_load(&sleepers) > 0) {
+        pthread_mutex_lock(&idle_mtx);
+        pthread_cond_signal(&idle_cv);
+        pthread_mutex_unlock(&idle_mtx);
+    }
+}
+
+void push_task(int w, task_t *t) {
+    runqueue_t *rq = &runqueues[w];
+    t->next = NULL;
+    pthread_mutex_lock(&rq->mtx);
+    if (rq->tail) rq->tail->next = t;
+    else rq->head = t;
+    rq->tail = t;
+    rq->count++;
+    pthread_mutex_unlock(&rq->mtx);
+    atomic_fetch_add(&ready_tasks, 1);
+    wake_idle();
+}
+
+task_t *pop_task(int w) {
+    runqueue_t *rq = &runqueues[w];
+    pthread_mutex_lock(&rq->mtx);
+    task_t *t = rq->head;
+    if (t) {
+        rq->head = t->next;
+        if (rq->head == NULL) rq->tail = NULL;
+        rq->count--;
+    }
+    pthread_mutex_unlock(&rq->mtx);
+    if (t) atomic_fetch_sub(&ready_tasks, 1);
+    return t;
+}
+
+// Move half of the first non-empty victim's queue onto our own
+task_t *steal_tasks(int w) {
+    for (int i = 1; i < workers; i++) {
+        runqueue_t *victim = &runqueues[(w + i) % workers];
+        if (victim->count == 0 || pthread_mutex_trylock(&victim->mtx) != 0) continue;
+        int take = (victim->count + 1) / 2;
+        task_t *first = victim->head, *last = first;
+        for (int k = 1; k < take && last; k++) last = last->next;
+        if (first) {
+            victim->head = last->next;
+            if (victim->head == NULL) victim->tail = NULL;
+            victim->count -= take;
+            last->next = NULL;
+        }
+        pthread_mutex_unlock(&victim->mtx);
+        if (first == NULL) continue;
+    
+        // Run the first stolen task now, queue the rest
+        task_t *rest = first->next;
+        atomic_fetch_sub(&ready_tasks, 1);
+        while (rest) {
+            task_t *t = rest;
+            rest = rest->next;
+            atomic_fetch_sub(&ready_tasks, 1);
+            push_task(w, t);
+        }
+        return first;
+    }
+    return NULL;
+}
+
+void arm_timer(task_t *t, int minutes) {
+    pthread_mutex_lock(&wheel_mtx);
+    t->slot = (wheel_tick + minutes) % WHEEL_SLOTS;
+    t->armed = true;
+    t->prev = NULL;
+    t->next = wheel[t->slot];
+    if (t->next) t->next->prev = t;
+    wheel[t->slot] = t;
+    pthread_mutex_unlock(&wheel_mtx);
+}
+
+// Take a timer off the wheel; false if it has already fired
+bool cancel_timer(task_t *t) {
+    pthread_mutex_lock(&wheel_mtx);
+    bool armed = t->armed;
+    if (armed) {
+        if (t->prev) t->prev->next = t->next;
+        else wheel[t->slot] = t->next;
+        if (t->next) t->next->prev = t->prev;
+        t->armed = false;
+    }
+    pthread_mutex_unlock(&wheel_mtx);
+    return armed;
+}
+
+// Fire every slot the clock has passed, onto this worker's queue
+void advance_wheel(int w) {
+    long now = park_time();
+    if (now <= atomic_load(&wheel_tick) || pthread_mutex_trylock(&wheel_mtx) != 0) return;
+    while (wheel_tick < now) {
+        int slot = (wheel_tick + 1) % WHEEL_SLOTS;
+        task_t *t = wheel[slot];
+        wheel[slot] = NULL;
+        atomic_fetch_add(&wheel_tick, 1);
+        while (t) {
+            task_t *next = t->next;
+            t->armed = false;
+            push_task(w, t);
+            t = next;
+        }
+    }
+    pthread_mutex_unlock(&wheel_mtx);
+}
+
+// After riders board, called with bmtx held: a full boat leaves now, the
+// first rider starts the boarding timeout. The timeout is the boat's own
+// BOAT_START timer, so if it has already fired the boat is on its way.
+void boarded(int w, task_t *boat) {
+    int id = boat->id;
+    if (BN[id] == capacity || max_wait == 0) {
+        if (loading == id) loading = -1;
+        if (boat->waiting) {
+            boat->waiting = false;
+            if (!cancel_timer(boat)) return;
+        }
+        boat->state = BOAT_START;
+        push_task(w, boat);
+    } else if (!boat->waiting) {
+        boat->waiting = true;
+        boat->state = BOAT_START;
+        arm_timer(boat, max_wait);
+    }
+}
+
+void run_visitor(int w, task_t *t) {
+    switch (t->state) {
+    case VISITOR_START:
+        printf("Visitor %d Starts sightseeing for %d minutes\n", t->id+1, t->vtime);
+        t->state = VISITOR_READY;
+        arm_timer(t, t->vtime);
+        break;
+    case VISITOR_READY: {
+        printf("Visitor %d Ready to ride a boat (ride time = %d)\n", t->id+1, VT[t->id]);
+        pthread_mutex_lock(&bmtx);
+        VR[t->id] = park_time();
+        int boat = board(t->id);
+        if (boat >= 0) boarded(w, &boat_tasks[boat]);
+        pthread_mutex_unlock(&bmtx);
+        break;
+    }
+    case VISITOR_LEAVE:
+        printf("Visitor %d Leaving \n", t->id+1);
+        pthread_mutex_lock(&bmtx);
+        bool last = --leftvisitors == 0;
+        pthread_mutex_unlock(&bmtx);
+        if (last) {
+            pthread_mutex_lock(&idle_mtx);
+            atomic_store(&park_closed, 1);
+            pthread_cond_broadcast(&idle_cv);
+            pthread_mutex_unlock(&idle_mtx);
+        }
+        break;
+    }
+}
+
+void run_boat(int w, task_t *t) {
+    switch (t->state) {
+    case BOAT_START:
+        // No one boards once the boat has left, so its riders are stable
+        // until it docks again
+        pthread_mutex_lock(&bmtx);
+        t->waiting = false;
+        depart(t->id);
+        pthread_mutex_unlock(&bmtx);
+        for (int i = 0; i < BN[t->id]; i++)
+            printf("Boat %d Start of ride for visitor %d\n", t->id+1, BR[t->id * capacity + i]+1);
+        t->state = BOAT_END;
+        arm_timer(t, BT[t->id]);
+        break;
+    case BOAT_END:
+        for (int i = 0; i < BN[t->id]; i++) {
+            task_t *rider = &visitor_tasks[BR[t->id * capacity + i]];
+            printf("Boat %d End of ride for visitor %d (ride time = %d)\n", t->id+1, rider->id+1, BT[t->id]);
+            rider->state = VISITOR_LEAVE;
+            push_task(w, rider);
+        }
+    
+        pthread_mutex_lock(&bmtx);
+        if (dock_boat(t->id) > 0) boarded(w, t);
+        pthread_mutex_unlock(&bmtx);
+        break;
+    }
+}
+
+// Sleep until a task is queued, the next minute starts or the park closes
+void idle_wait() {
+    long tick = atomic_load(&wheel_tick) + 1;
+    struct timespec deadline = park_deadline(tick);
+    
+    pthread_mutex_lock(&idle_mtx);
+    atomic_fetch_add(&sleepers, 1);
+    if (atomic_load(&ready_tasks) == 0 && !atomic_load(&park_closed) && park_time() < tick) {
+        pthread_cond_timedwait(&idle_cv, &idle_mtx, &deadline);
+    }
+    atomic_fetch_sub(&sleepers, 1);
+    pthread_mutex_unlock(&idle_mtx);
+}
+
+void *worker_thread(void *arg) {
+    int w = *(int *)arg;
+    while (!atomic_load(&park_closed)) {
+        advance_wheel(w);
+        task_t *t = pop_task(w);
+        if (t == NULL) t = steal_tasks(w);
+        if (t == NULL) {
+            idle_wait();
+            continue;
+        }
+        if (t->boat) run_boat(w, t);
+        else run_visitor(w, t);
+    }
+    return NULL;
+}
+
+void run_pool() {
+    pthread_t *threads = malloc(workers * sizeof(pthread_t));
+    int *worker_ids = malloc(workers * sizeof(int));
+    runqueues = calloc(workers, sizeof(runqueue_t));
+    visitor_tasks = calloc(n, sizeof(task_t));
+    boat_tasks = calloc(m, sizeof(task_t));
+    
+    init_cond(&idle_cv);
+    
+    for (int i = 0; i < workers; i++) {
+        pthread_mutex_init(&runqueues[i].mtx, NULL);
+    }
+    
+    for (int i = 0; i < m; i++) {
+        boat_tasks[i] = (task_t){ .boat = true, .id = i };
+        printf("Boat %d Ready\n", i+1);
+        FB[nfree++] = m - 1 - i; // Boat 1 on top, as it is in thread mode
+    }
+    
+    // Spread the visitors over the run queues; their first step prints the
+    // sightseeing line and arms the timer
+    for (int i = 0; i < n; i++) {
+        visitor_tasks[i] = (task_t){ .id = i, .state = VISITOR_START };
+        visitor_tasks[i].vtime = rand() % 91 + 30;
+        VT[i] = rand() % 46 + 15;
+        push_task(i % workers, &visitor_tasks[i]);
+    }
+    
+    for (int i = 0; i < workers; i++) {
+        worker_ids[i] = i;
+        pthread_create(&threads[i], NULL, worker_thread, &worker_ids[i]);
+    }
+    for (int i = 0; i < workers; i++) pthread_join(threads[i], NULL);
+    printf("All visitors have left\n");
+    
+    free(threads);
+    free(worker_ids);
+    free(runqueues);
+    free(visitor_tasks);
+    free(boat_tasks);
+}
+
+void print_report() {
+    double minutes = park_time();
+    printf("Boats: %ld rides, %.1f%% of seats filled, riding %.1f%% of the time\n", rides,
+           rides ? 100.0 * seats_taken / (rides * capacity) : 0.0,
+           minutes > 0 ? 100.0 * ride_minutes / (m * minutes) : 0.0);
+    printf("Visitors: mean queueing delay %.1f minutes\n",
+           seats_taken ? queue_minutes / seats_taken : 0.0);
+}
+
+void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-p] [-j workers] [-t minute_us] [-c seats] [-w max_wait] <boats> <visitors>\n"
+            "  -p  run visitors and boats as tasks on one worker per core\n"
+            "  -j  number of workers (implies -p)\n"
+            "  -t  wall-clock microseconds per park minute (default 100000)\n"
+            "  -c  seats per boat (default 1)\n"
+            "  -w  minutes a part-filled boat waits for more riders (default 10)\n", prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "pj:t:c:w:")) != -1) {
+        switch (opt) {
+        case 'p': if (workers == 0) workers = sysconf(_SC_NPROCESSORS_ONLN); break;
+        case 'j': workers = atoi(optarg); break;
+        case 't': minute_us = atoi(optarg); break;
+        case 'c': capacity = atoi(optarg); break;
+        case 'w': max_wait = atoi(optarg); break;
+        default: usage(argv[0]);
+        }
+    }
+    if (argc - optind != 2 || workers < 0 || minute_us <= 0 || capacity <= 0 ||
+        max_wait < 0 || max_wait >= WHEEL_SLOTS) usage(argv[0]);
+    
+    m = atoi(argv[optind]);
+    n = atoi(argv[optind + 1]);
+
+    leftvisitors = n;
+    
+    pthread_mutex_init(&bmtx, NULL);
+    
+    BN = calloc(m, sizeof(int));
+    BR = malloc(m * capacity * sizeof(int));
+    BT = calloc(m, sizeof(int));
+    BG = calloc(m, sizeof(int));
+    BF = calloc(m, sizeof(double));
+    VT = calloc(n, sizeof(int));
+    VG = calloc(n, sizeof(int));
+    VR = calloc(n, sizeof(double));
+    FB = malloc(m * sizeof(int));
+    WQ = malloc(n * sizeof(int));
+    nfree = whead = wtail = 0;
+    clock_gettime(CLOCK_MONOTONIC, &park_start);
+    
+    if (workers > 0) run_pool();
+    else run_threads();
+    print_report();
+    
+    free(BN);
+    free(BR);
     free(BT);
-    free(BB);
+    free(BG);
+    free(BF);
+    free(VT);
+    free(VG);
+    free(VR);
+    free(FB);
+    free(WQ);
     pthread_mutex_destroy(&bmtx);
-    pthread_barrier_destroy(&EOS);
     return 0;
 }
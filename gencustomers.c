@@ -1,35 +1,178 @@
+#include "trace_format.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <math.h>
 #include <time.h>
 
-int main ( )
+/*
+ * Customer trace generator.
+ *
+ *   gencustomers [-s seed] [-n count] [-e end] [-a process] [-r rate]
+ *                [-b on,off] [-d peak,width] [-p weights] [-B]
+ *
+ * With no options it reproduces the classic trace: 7 customers at t = 0,
+ * then uniform 0..9 minute gaps until t > 250, parties of 1 (1/2),
+ * 2 (1/4), 3 or 4 (1/8 each).
+ *
+ *   -s  seed (default: time of day); the same seed gives the same trace
+ *   -n  stop after this many customers instead of at the end time
+ *   -e  last arrival minute when -n is not given (default 250)
+ *   -a  arrival process: classic, poisson, bursty or diurnal
+ *   -r  mean arrivals per minute for poisson/bursty/diurnal (default 0.22)
+ *   -b  bursty on/off period lengths in minutes (default 20,40); arrivals
+ *       only happen while on, at a rate that keeps -r as the overall mean
+ *   -d  diurnal peak minute and width (default 90,30); the rate rises from
+ *       a quarter of -r off-peak to twice -r at the peak
+ *   -p  party-size weights for sizes 1, 2, ... (default 4,2,1,1)
+ *   -B  write the binary trace format (see trace_record_t) instead of text
+ */
+
+enum { PROC_CLASSIC, PROC_POISSON, PROC_BURSTY, PROC_DIURNAL };
+
+#define MAX_PARTY 32
+
+static uint64_t rng_state;
+
+// splitmix64: small, seedable and identical on every libc
+static uint64_t next_random(void)
+{
+   uint64_t z = (rng_state += 0x9e3779b97f4a7c15ULL);
+   z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+   z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+   return z ^ (z >> 31);
+}
+
+// Uniform in (0, 1]
+static double next_uniform(void)
+{
+   return ((next_random() >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+static double next_exponential(double rate)
 {
-   int i, t, c, n;
+   return -log(next_uniform()) / rate;
+}
 
-   srand((unsigned int)time(NULL));
+static int party_weights[MAX_PARTY];
+static int party_sizes = 0;
+static int party_total = 0;
 
-   t = n = 0;
+static int next_party(void)
+{
+   int pick = next_random() % party_total;
+   int size = 0;
+   while (pick >= party_weights[size]) pick -= party_weights[size++];
+   return size + 1;
+}
 
-   i = 7;
-   while (i) {
-      ++n;
-      if (rand() % 2) c = 1;
-      else if (rand() % 2) c = 2;
-      else c = (rand() % 2) ? 3 : 4;
-      printf("%d %d %d\n", n, t, c);
-      --i;
+static double diurnal_rate(double t, double rate, double peak, double width)
+{
+   double x = (t - peak) / width;
+   return rate * (0.25 + 1.75 * exp(-x * x));
+}
+
+static void usage(const char *prog)
+{
+   fprintf(stderr, "Usage: %s [-s seed] [-n count] [-e end] [-a classic|poisson|bursty|diurnal]\n"
+           "          [-r rate] [-b on,off] [-d peak,width] [-p weights] [-B]\n", prog);
+   exit(1);
+}
+
+int main (int argc, char *argv[])
+{
+   uint64_t seed = (uint64_t)time(NULL);
+   long count = -1;
+   int end = 250, process = PROC_CLASSIC, binary = 0;
+   double rate = 0.22, on = 20, off = 40, peak = 90, width = 30;
+   const char *weights = "4,2,1,1";
+   int opt;
+
+   while ((opt = getopt(argc, argv, "s:n:e:a:r:b:d:p:B")) != -1) {
+      switch (opt) {
+      case 's': seed = strtoull(optarg, NULL, 0); break;
+      case 'n': count = atol(optarg); break;
+      case 'e': end = atoi(optarg); break;
+      case 'a':
+         if (strcmp(optarg, "classic") == 0) process = PROC_CLASSIC;
+         else if (strcmp(optarg, "poisson") == 0) process = PROC_POISSON;
+         else if (strcmp(optarg, "bursty") == 0) process = PROC_BURSTY;
+         else if (strcmp(optarg, "diurnal") == 0) process = PROC_DIURNAL;
+         else usage(argv[0]);
+         break;
+      case 'r': rate = atof(optarg); break;
+      case 'b': if (sscanf(optarg, "%lf,%lf", &on, &off) != 2) usage(argv[0]); break;
+      case 'd': if (sscanf(optarg, "%lf,%lf", &peak, &width) != 2) usage(argv[0]); break;
+      case 'p': weights = optarg; break;
+      case 'B': binary = 1; break;
+      default: usage(argv[0]);
+      }
    }
 
-   while (1) {
+   for (const char *p = weights; *p && party_sizes < MAX_PARTY; ) {
+      char *next;
+      long w = strtol(p, &next, 10);
+      if (next == p || w < 0) usage(argv[0]);
+      party_weights[party_sizes++] = w;
+      party_total += w;
+      p = (*next == ',') ? next + 1 : next;
+   }
+   if (rate <= 0 || on <= 0 || off < 0 || width <= 0 || party_total == 0 || count == 0) {
+      usage(argv[0]);
+   }
+
+   rng_state = seed;
+   fprintf(stderr, "gencustomers: seed %llu\n", (unsigned long long)seed);
+
+   if (binary) {
+      trace_header_t header = { TRACE_MAGIC, TRACE_VERSION };
+      fwrite(&header, sizeof(header), 1, stdout);
+   } else {
+      // Large traces are written in one pass; let stdio batch them
+      setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+   }
+
+   // Arrivals in continuous minutes; busy counts only the minutes spent in
+   // bursty on windows
+   double t = 0, busy = 0, peak_rate = diurnal_rate(peak, rate, peak, width);
+   double on_rate = rate * (on + off) / on;
+   long n = 0;
+
+   while (count < 0 || n < count) {
+      switch (process) {
+      case PROC_CLASSIC:
+         if (n >= 7) t += next_random() % 10;
+         break;
+      case PROC_POISSON:
+         t += next_exponential(rate);
+         break;
+      case PROC_BURSTY:
+         // Poisson inside on windows, mapped back to the wall minute
+         busy += next_exponential(on_rate);
+         t = floor(busy / on) * (on + off) + fmod(busy, on);
+         break;
+      case PROC_DIURNAL:
+         // Thinning: draw at the peak rate, keep with probability rate(t)/peak
+         do {
+            t += next_exponential(peak_rate);
+         } while (next_uniform() * peak_rate > diurnal_rate(t, rate, peak, width));
+         break;
+      }
+      if (count < 0 && t > end && process != PROC_CLASSIC) break;
+
       ++n;
-      t += rand() % 10;
-      if (rand() % 2) c = 1;
-      else if (rand() % 2) c = 2;
-      else c = (rand() % 2) ? 3 : 4;
-      printf("%d %d %d\n", n, t, c);
-      if (t > 250) break;
+      trace_record_t rec = { (uint32_t)n, (uint32_t)t, (uint32_t)next_party() };
+      if (binary) {
+         fwrite(&rec, sizeof(rec), 1, stdout);
+      } else {
+         printf("%u %u %u\n", rec.id, rec.arrival, rec.party);
+      }
+
+      // The classic trace includes the first arrival past the end
+      if (process == PROC_CLASSIC && count < 0 && t > end) break;
    }
-   printf("-1\n");
+   if (!binary) printf("-1\n");
 
    exit(0);
 }
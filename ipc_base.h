@@ -0,0 +1,292 @@
+#ifndef IPC_BASE_H
+#define IPC_BASE_H
+
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/sem.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#ifdef USE_FUTEX
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+// Building blocks every SimuDine header and tool shares: IPC keys, the
+// semaphore backend and the names roles go by in output
+#define PROJ_ID 42
+#define CACHE_LINE 64
+
+#define CACHE_ALIGNED __attribute__((aligned(CACHE_LINE)))
+#define ALIGN_UP(n) (((n) + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1))
+
+// Fixed semaphore indices; the ranges sized from the configuration follow
+// them (see ipc_shared.h).
+//
+// Lock domains (binary semaphores):
+//   TABLES_SEM       - EMPTY_TABLES, NEXT_WAITER, free seats
+//   KITCHEN_SEM      - the kitchen priority queue (non-FIFO policies only)
+//                      and the kitchen credits (see kitchen_take_credit)
+//   CLOCK_SEM        - the virtual clock calendar
+// The waiter, cook and food-ready queues are lock-free rings and the
+// simulated clock is a single atomic (see sim_clock_t); they take no lock.
+// Lock domains are taken with take_lock(), which times contended waits for
+// the live telemetry (see telemetry_t).
+//
+// Lock ordering: TABLES_SEM -> KITCHEN_SEM -> CLOCK_SEM.
+// A lock may only be taken while holding locks that come earlier in this order.
+enum {
+    TABLES_SEM = 0,    // Protects seating state
+    COOK_SEM,          // Signals cooks
+    KITCHEN_SEM,       // Protects the kitchen priority queue
+    CLOCK_SEM,         // Protects the virtual clock calendar
+    FIXED_SEMS
+};
+
+// Names for log output: letters while they last, then letter + index
+static inline const char *cook_name(int cook_id) {
+    static char name[16];
+    if (cook_id < 18) snprintf(name, sizeof(name), "%c", 'C' + cook_id);
+    else snprintf(name, sizeof(name), "C%d", cook_id);
+    return name;
+}
+
+static inline const char *waiter_name(int waiter_id) {
+    static char name[16];
+    if (waiter_id < 6) snprintf(name, sizeof(name), "%c", 'U' + waiter_id);
+    else snprintf(name, sizeof(name), "U%d", waiter_id);
+    return name;
+}
+
+// Number of semaphore system calls made by this process (see sembench.c)
+static unsigned long sem_syscalls = 0;
+
+// Instance namespace. Every IPC key is derived from it, so sessions with
+// different instance names can run side by side on one host. Roles take it
+// from the environment; their -N option sets the variable, so everything
+// they fork or exec inherits it.
+#define INSTANCE_ENV "SIMUDINE_INSTANCE"
+
+static inline void set_instance(const char *name) {
+    if (setenv(INSTANCE_ENV, name, 1) == -1) {
+        perror("setenv");
+        exit(1);
+    }
+}
+
+// Key for one of the session's IPC objects. Without an instance these are
+// the historical ftok("/tmp", ...) keys; with one, an FNV-1a hash of the
+// name fills the upper bits and proj_id tells the objects apart.
+static inline key_t instance_key(int proj_id) {
+    const char *instance = getenv(INSTANCE_ENV);
+    if (instance == NULL || *instance == '\0') {
+        key_t key = ftok("/tmp", proj_id);
+        if (key == -1) {
+            perror("ftok");
+            exit(1);
+        }
+        return key;
+    }
+    
+    uint32_t hash = 2166136261u;
+    for (const char *p = instance; *p; p++) {
+        hash = (hash ^ (unsigned char)*p) * 16777619u;
+    }
+    return (key_t)((hash & 0x7fffff00u) | (proj_id & 0xff));
+}
+
+// Common function to get IPC keys
+static inline key_t get_key() {
+    return instance_key(PROJ_ID);
+}
+
+#ifdef USE_FUTEX
+
+// Futex-backed counting semaphores living in their own shared memory
+// segment. The uncontended take/put is a single atomic operation; the
+// kernel is only entered to sleep on an empty semaphore or to wake a
+// sleeper. `semid` is the id of that segment.
+typedef struct {
+    _Atomic int value;
+    _Atomic int sleepers;
+} futex_sem_t;
+
+typedef struct {
+    _Atomic int removed;     // Set by semset_remove(), fails pending takes
+    int nsems;
+    futex_sem_t sems[];
+} futex_semset_t;
+
+static futex_semset_t *futex_set = NULL;
+
+static inline key_t get_sem_key() {
+    return instance_key(PROJ_ID + 1);
+}
+
+static inline futex_semset_t *semset_attach(int semid) {
+    if (futex_set == NULL) {
+        void *p = shmat(semid, NULL, 0);
+        if (p == (void *) -1) {
+            perror("shmat: semaphores");
+            exit(1);
+        }
+        futex_set = (futex_semset_t *)p;
+    }
+    return futex_set;
+}
+
+static inline long futex(_Atomic int *addr, int op, int val) {
+    sem_syscalls++;
+    return syscall(SYS_futex, (int *)addr, op, val, NULL, NULL, 0);
+}
+
+static inline int semset_get(int nsems, int flags) {
+    return shmget(get_sem_key(), sizeof(futex_semset_t) + nsems * sizeof(futex_sem_t), flags);
+}
+
+static inline int semset_setall(int semid, unsigned short *values) {
+    futex_semset_t *set = semset_attach(semid);
+    struct shmid_ds ds;
+    if (shmctl(semid, IPC_STAT, &ds) == -1) return -1;
+    set->nsems = (ds.shm_segsz - sizeof(futex_semset_t)) / sizeof(futex_sem_t);
+    atomic_store(&set->removed, 0);
+    for (int i = 0; i < set->nsems; i++) {
+        atomic_store(&set->sems[i].value, values[i]);
+        atomic_store(&set->sems[i].sleepers, 0);
+    }
+    return 0;
+}
+
+static inline int semset_remove(int semid) {
+    futex_semset_t *set = semset_attach(semid);
+    atomic_store(&set->removed, 1);
+    for (int i = 0; i < set->nsems; i++) {
+        futex(&set->sems[i].value, FUTEX_WAKE, INT_MAX);
+    }
+    return shmctl(semid, IPC_RMID, NULL);
+}
+
+static inline void take(int semid, int sem_num) {
+    futex_semset_t *set = semset_attach(semid);
+    futex_sem_t *sem = &set->sems[sem_num];
+    
+    while (1) {
+        int v = atomic_load(&sem->value);
+        while (v > 0) {
+            if (atomic_compare_exchange_weak(&sem->value, &v, v - 1)) return;
+        }
+        if (atomic_load(&set->removed)) {
+            fprintf(stderr, "semop: take: %s\n", strerror(EIDRM));
+            exit(1);
+        }
+        
+        // Sleep until value leaves 0; a put() in between makes this return at once
+        atomic_fetch_add(&sem->sleepers, 1);
+        if (futex(&sem->value, FUTEX_WAIT, 0) == -1 && errno != EAGAIN && errno != EINTR) {
+            perror("futex: take");
+            exit(1);
+        }
+        atomic_fetch_sub(&sem->sleepers, 1);
+    }
+}
+
+// Take sem only if that needs no waiting. Returns 1 if it was taken.
+static inline int try_take(int semid, int sem_num) {
+    futex_sem_t *sem = &semset_attach(semid)->sems[sem_num];
+    int v = atomic_load(&sem->value);
+    while (v > 0) {
+        if (atomic_compare_exchange_weak(&sem->value, &v, v - 1)) return 1;
+    }
+    return 0;
+}
+
+static inline void put(int semid, int sem_num) {
+    futex_semset_t *set = semset_attach(semid);
+    futex_sem_t *sem = &set->sems[sem_num];
+    
+    atomic_fetch_add(&sem->value, 1);
+    if (atomic_load(&sem->sleepers) > 0) {
+        if (futex(&sem->value, FUTEX_WAKE, 1) == -1) {
+            perror("futex: put");
+            exit(1);
+        }
+    }
+}
+
+#else
+
+// For semctl initialization
+union semun {
+    int val;
+    struct semid_ds *buf;
+    unsigned short *array;
+};
+
+static inline int semset_get(int nsems, int flags) {
+    return semget(get_key(), nsems, flags);
+}
+
+static inline int semset_setall(int semid, unsigned short *values) {
+    union semun arg;
+    arg.array = values;
+    return semctl(semid, 0, SETALL, arg);
+}
+
+static inline int semset_remove(int semid) {
+    return semctl(semid, 0, IPC_RMID);
+}
+
+// Utility functions for semaphores
+static inline void take(int semid, int sem_num) {
+    struct sembuf sb;
+    sb.sem_num = sem_num;
+    sb.sem_op = -1;
+    sb.sem_flg = 0;
+    sem_syscalls++;
+    if (semop(semid, &sb, 1) == -1) {
+        perror("semop: take");
+        exit(1);
+    }
+}
+
+// Take sem only if that needs no waiting. Returns 1 if it was taken.
+static inline int try_take(int semid, int sem_num) {
+    struct sembuf sb;
+    sb.sem_num = sem_num;
+    sb.sem_op = -1;
+    sb.sem_flg = IPC_NOWAIT;
+    sem_syscalls++;
+    if (semop(semid, &sb, 1) == 0) {
+        return 1;
+    }
+    if (errno != EAGAIN) {
+        perror("semop: take");
+        exit(1);
+    }
+    return 0;
+}
+
+static inline void put(int semid, int sem_num) {
+    struct sembuf sb;
+    sb.sem_num = sem_num;
+    sb.sem_op = 1;
+    sb.sem_flg = 0;
+    sem_syscalls++;
+    if (semop(semid, &sb, 1) == -1) {
+        perror("semop: put");
+        exit(1);
+    }
+}
+
+#endif // USE_FUTEX
+
+#endif // IPC_BASE_H
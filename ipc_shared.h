@@ -1,130 +1,1213 @@
 #ifndef IPC_SHARED_H
 #define IPC_SHARED_H
 
-#include <sys/types.h>
-#include <sys/ipc.h>
-#include <sys/shm.h>
-#include <sys/sem.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <unistd.h>
-#include <sys/wait.h>
-
-#define MAX_CUSTOMERS 200
-#define MAX_TABLES 10
-#define NUM_WAITERS 5
-#define PROJ_ID 42
-#define SHM_SIZE 2000
-#define QUEUE_SIZE 100
-
-// Shared memory structure starts with the first 100 cells
-// M[0] = time (initialized to 0)
-// M[1] = empty tables (initialized to 10)
-// M[2] = next waiter to serve (initialized to 0)
-// M[3] = pending orders for cooks (initialized to 0)
+#include "ipc_base.h"
+#include "menu.h"
+#include "telemetry.h"
+#include "event_log.h"
+
+// Default staffing and capacity; the cook process can override each of
+// these on its command line (see cook.c) and stores the result in the
+// shared segment for the other roles
+#define DEFAULT_TABLES 10
+#define DEFAULT_WAITERS 5
+#define DEFAULT_COOKS 2
+#define DEFAULT_QUEUE_SIZE 128   // Rounded up to a power of two
+#define LATENCY_SUB_BITS 5       // Latency buckets per doubling: 2^5, so within 1/32
+#define LATENCY_BUCKETS ((32 - LATENCY_SUB_BITS) << LATENCY_SUB_BITS)   // Any int minutes
+#define COOK_MINUTES_PER_PERSON 5
+#define CLOSING_TIME 180         // 3:00pm, in minutes after 11:00am
+
+// Shared memory layout identification; bump SHM_VERSION whenever
+// shared_t changes so stale binaries refuse to attach
+#define SHM_MAGIC 0x53444e45   // "SDNE"
+#define SHM_VERSION 19
 
 // Semaphore indices
+//
+// The fixed semaphores (the lock domains and COOK_SEM, see ipc_base.h) are
+// followed by ranges sized from the configuration:
+// a private timer per cook, per waiter, for the arrival feed and for the
+// event-driven customers' timer thread (customer -e), a wakeup
+// per waiter, one wakeup per table (seat), then for each kitchen station
+// after the first a wakeup and a wait for room in its queue (see
+// STATION_SEM and STATION_SPACE_SEM). A seated
+// customer waits on its seat's semaphore, so the set never grows with the
+// number of customers.
+#define COOK_TIMER_SEM(shm, c) (FIXED_SEMS + (c))
+#define WAITER_TIMER_SEM(shm, w) (FIXED_SEMS + (shm)->config.cooks + (w))
+#define ARRIVAL_TIMER_SEM(shm) (FIXED_SEMS + (shm)->config.cooks + (shm)->config.waiters)
+#define MEAL_TIMER_SEM(shm) (ARRIVAL_TIMER_SEM(shm) + 1)
+#define WAITER_SEM(shm, w) (MEAL_TIMER_SEM(shm) + 1 + (w))
+#define SEAT_SEM(shm, s) (WAITER_SEM(shm, 0) + (shm)->config.waiters + (s))
+#define STATION_SEM(shm, s) (SEAT_SEM(shm, 0) + (shm)->config.tables + (s) - 1)
+#define STATION_SPACE_SEM(shm, s) (STATION_SEM(shm, s) + later_stations(&(shm)->config))
+#define TOTAL_SEMS(shm) config_sems(&(shm)->config)
+
+// Waiter assignment policies used when seating a customer
+enum {
+    ASSIGN_ROUND_ROBIN = 0,   // Strict rotation over NEXT_WAITER
+    ASSIGN_LEAST_PENDING,     // Waiter with the smallest backlog, rotation breaks ties
+    ASSIGN_TWO_CHOICES,       // Less loaded of two random waiters
+    NUM_ASSIGN_POLICIES
+};
+
+static const char *const assign_policy_names[NUM_ASSIGN_POLICIES] = {
+    "round-robin", "least-pending", "two-choices"
+};
+
+// Kitchen scheduling policies: which queued order a free cook starts next
 enum {
-    MUTEX_SEM = 0,     // Protects shared memory
-    COOK_SEM,          // Signals cooks
-    WAITER_SEM_BASE,   // Base index for waiter semaphores
-    CUSTOMER_SEM_BASE = WAITER_SEM_BASE + NUM_WAITERS // Base index for customer semaphores
+    KITCHEN_FIFO = 0,         // Order the waiters submitted them in
+    KITCHEN_SJF,              // Smallest party first, can starve large parties
+    KITCHEN_DEADLINE,         // Earliest (seated + cook time): SJF aged by waiting time
+    NUM_KITCHEN_POLICIES
 };
 
-// Total semaphores needed
-#define TOTAL_SEMS (CUSTOMER_SEM_BASE + MAX_CUSTOMERS)
-
-// Convenience macro for accessing shared memory
-#define TIME(shm) shm[0]
-#define EMPTY_TABLES(shm) shm[1]
-#define NEXT_WAITER(shm) shm[2]
-#define PENDING_ORDERS(shm) shm[3]
-
-// Waiter area offsets
-#define WAITER_AREA_SIZE 200
-#define WAITER_AREA_START 100
-#define WAITER_AREA(w) (WAITER_AREA_START + (w) * WAITER_AREA_SIZE)
-
-// Waiter queue index offsets
-#define WAITER_FRONT(w) (WAITER_AREA(w))
-#define WAITER_REAR(w) (WAITER_AREA(w) + 1)
-#define WAITER_FOOD_READY(w) (WAITER_AREA(w) + 2)
-#define WAITER_PENDING_ORDERS(w) (WAITER_AREA(w) + 3)
-#define WAITER_QUEUE_START(w) (WAITER_AREA(w) + 4)
-
-// Cook queue offsets
-#define COOK_QUEUE_START 1100
-#define COOK_FRONT (COOK_QUEUE_START)
-#define COOK_REAR (COOK_QUEUE_START + 1)
-#define COOK_QUEUE_DATA (COOK_QUEUE_START + 2)
-
-// For semctl initialization
-union semun {
-    int val;
-    struct semid_ds *buf;
-    unsigned short *array;
+static const char *const kitchen_policy_names[NUM_KITCHEN_POLICIES] = {
+    "fifo", "sjf", "deadline"
 };
 
-// Utility functions for semaphores
-static void take(int semid, int sem_num) {
-    struct sembuf sb;
-    sb.sem_num = sem_num;
-    sb.sem_op = -1;
-    sb.sem_flg = 0;
-    if (semop(semid, &sb, 1) == -1) {
-        perror("semop: take");
+// Kitchen stations (cook -S). Without them a cook takes a whole order and
+// spends count * COOK_MINUTES_PER_PERSON minutes on it. With them an order
+// enters the kitchen as one dish per guest and each dish moves down a chain
+// of stations, each with its own cooks and queue. The first station takes
+// dishes off the cook ring under the kitchen policy; the plate station ends
+// the chain, waits for all of an order's dishes and plates them together.
+// The kinds of station and the dishes they make are in menu.h.
+#define MAX_STATIONS 8
+#define PLATE_MINUTES_PER_ORDER 1
+
+// Batch cooking (cook -B). A first-station cook that takes a dish also
+// takes queued dishes of the same kind and makes them together: the first
+// portion costs the dish's full time, every further one batch_extra percent
+// of it. With batch_wait the cook holds a short batch open for up to that
+// many minutes in case more of the dish comes in.
+#define MAX_BATCH 16
+#define DEFAULT_BATCH_EXTRA 25
+
+// Record/replay of synchronization decisions (cook -R / -P)
+enum {
+    DECISIONS_OFF = 0,
+    DECISIONS_RECORD,
+    DECISIONS_REPLAY
+};
+
+// Staffing and capacity of one session
+typedef struct {
+    int tables;
+    int waiters;
+    int cooks;
+    int queue_size;    // Capacity of each order ring, a power of two
+    int assign_policy; // ASSIGN_*
+    int steal;         // Idle waiters take orders from the busiest waiter
+    int kitchen_policy; // KITCHEN_*
+    int event_log;     // Record events in shared rings instead of printing them
+    int decisions;     // DECISIONS_*: record or replay synchronization decisions
+    int decision_capacity; // Records the decision log holds
+    int stations;      // Kitchen stations in the chain, 0 for whole-order cooks
+    int station_kind[MAX_STATIONS];    // STATION_*
+    int station_cooks[MAX_STATIONS];   // Cooks at each station; they sum to cooks
+    int batch_max;     // Largest batch of one dish, 1 (or 0) to cook dishes singly
+    int batch_wait;    // Minutes a short batch may be held open
+    int batch_extra;   // Cost of each extra portion, in percent of the dish's time
+} config_t;
+
+// One order travelling through the waiter and cook queues
+typedef struct {
+    int waiter_id;
+    int customer_id;
+    int count;
+    int seat;          // Table the customer waits at
+    int queued_at;     // Minute the customer was seated and queued the order
+    int item;          // With stations: the guest whose dish this entry is
+} order_t;
+
+// Bounded lock-free ring of orders living in shared memory. Each slot
+// carries a sequence number: seq == pos means the slot is free for the
+// producer claiming pos, seq == pos + 1 means it holds the entry for pos.
+typedef struct {
+    _Atomic unsigned seq;
+    order_t order;
+} ring_slot_t;
+
+typedef struct {
+    unsigned mask CACHE_ALIGNED;           // Capacity - 1
+    _Atomic unsigned head CACHE_ALIGNED;   // Next position to dequeue
+    _Atomic unsigned tail CACHE_ALIGNED;   // Next position to enqueue
+    ring_slot_t slots[] CACHE_ALIGNED;
+} order_ring_t;
+
+#define RING_BYTES(queue_size) ALIGN_UP(sizeof(order_ring_t) + (queue_size) * sizeof(ring_slot_t))
+
+// Per-waiter region: the backlog counter, followed by the waiter's MPSC
+// order ring (customers -> waiter) and its MPSC food-ready mailbox
+// (cooks -> waiter)
+typedef struct {
+    _Atomic int pending_orders CACHE_ALIGNED;   // Orders queued with this waiter
+    _Atomic int idle;                           // Blocked waiting for work
+} waiter_area_t;
+
+// Orders the kitchen has pulled off the cook ring, kept as a binary
+// min-heap by policy key. Only used by non-FIFO policies, under KITCHEN_SEM.
+typedef struct {
+    int size CACHE_ALIGNED;
+    order_t orders[];
+} kitchen_heap_t;
+
+// Histogram of a simulated latency. Buckets are one minute wide up to
+// 2 << LATENCY_SUB_BITS minutes, then each doubling is split into
+// 1 << LATENCY_SUB_BITS buckets (see latency_bucket), so a long tail is
+// kept to within a few percent instead of piling up in a last bucket.
+typedef struct {
+    _Atomic int count;
+    _Atomic long total;
+    _Atomic int max;
+    _Atomic int buckets[LATENCY_BUCKETS];
+} latency_hist_t;
+
+// Lifecycle stages of a customer, each measured between two stamps
+enum {
+    STAGE_SEATING = 0,        // Arrived -> seated
+    STAGE_ORDER,              // Seated -> order taken by a waiter
+    STAGE_KITCHEN,            // Order taken -> a cook starts on it
+    STAGE_SERVICE,            // Cook starts -> food served
+    STAGE_DINING,             // Served -> left the table
+    NUM_STAGES
+};
+
+static const char *const stage_names[NUM_STAGES] = {
+    "arrival_to_seated", "seated_to_order_taken", "order_taken_to_cook_start",
+    "cook_start_to_served", "served_to_left"
+};
+
+// Minute stamps of the customer currently at a seat. Each stamp is written
+// by one role before it hands the order on, so the next role sees it.
+typedef struct {
+    int arrived;
+    int seated;
+    int order_taken;      // Waiter
+    int cook_start;       // Cook
+    int served;           // Waiter
+} lifecycle_t;
+
+// Virtual clock (fast-forward mode) calendar.
+// The calendar is a binary min-heap of (wakeup minute, semaphore) pairs.
+// Wakeups for the same minute are released in the order they were booked
+// (seq), not in whatever order the heap happens to hold them.
+// runnable counts participants that are running or have been handed a
+// wakeup they have not consumed yet; the clock only jumps when it is 0.
+// tokens/waiters (one per semaphore) and the heap follow this header.
+typedef struct {
+    int when;
+    int sem;
+    unsigned seq;
+} vclock_event_t;
+
+typedef struct {
+    int enabled CACHE_ALIGNED;
+    int runnable;
+    int heap_size;
+    unsigned next_seq;   // Booking order of the next calendar entry
+} vclock_t;
+
+// Decision log (cook -R / -P): what a recording has logged so far, or the
+// recording a replay follows. decisions.h has the sections that fill it in
+// and the file it is saved to.
+enum {
+    DECISION_SEAT = 0,        // value = seat, -1 if closed or full
+    DECISION_ORDER,           // value = 1 if the waiter's queue took the order
+    DECISION_LEAVE,           // value = seat
+    DECISION_WAITER_WAKE,     // value = customer whose order was taken, -1 if none
+    DECISION_WAITER_SUBMIT,   // value = 1 if the kitchen took an entry, 0 if no credit
+    DECISION_COOK_TAKE,       // value = customer dequeued, -1 if none
+    DECISION_COOK_DONE,       // value = customer
+    NUM_DECISIONS
+};
+
+static const char *const decision_names[NUM_DECISIONS] = {
+    "seat", "order", "leave", "waiter-wake", "waiter-submit", "cook-take", "cook-done"
+};
+
+typedef struct {
+    uint32_t actor;      // See DECISION_COOK() in decisions.h
+    uint16_t kind;       // DECISION_*
+    uint16_t minute;     // Simulated time the section started
+    int32_t value;       // Outcome, checked on replay
+} decision_t;
+
+typedef struct {
+    _Atomic unsigned long next_ticket CACHE_ALIGNED;   // Record: sections started
+    _Atomic unsigned long turn CACHE_ALIGNED;          // Sections finished
+    unsigned long count;     // Replay: records loaded
+    _Atomic int overflow;    // Record: more sections than DECISION_CAPACITY
+    _Atomic int diverged;    // Replay: a role no longer matches the log
+    _Atomic int parked;      // Replay: roles waiting off the clock for their turn
+    decision_t records[] CACHE_ALIGNED;
+} decision_log_t;
+
+// Participants that can sleep on the calendar at once
+#define VCLOCK_HEAP_CAP(c) ((c)->cooks + (c)->waiters + 2 + (c)->tables)
+
+// Byte offsets of the variable-sized regions, computed from the config
+typedef struct {
+    size_t seats;          // int[tables], free seat stack
+    size_t lifecycle;      // lifecycle_t[tables], one per seat
+    size_t waiters;        // waiter_area_t + ring + mailbox, waiter_stride bytes each
+    size_t waiter_stride;
+    int mailbox_size;      // Mailbox capacity, enough for an order from every table
+    size_t cook_ring;
+    size_t kitchen;        // kitchen_heap_t with queue_size orders
+    size_t stations;       // A ring per station after the first, if stations
+    size_t tickets;        // int[tables]: dishes of the seat's order not yet at the plate station
+    size_t blocked;        // int[waiters]: circular queue of waiters blocked for a kitchen credit
+    size_t events;         // event_ring_t per cook, per waiter and for customers, if event_log
+    size_t decisions;      // decision_log_t with decision_capacity records, if decisions
+    size_t vclock;         // vclock_t, then tokens, waiters and heap
+    size_t size;
+} layout_t;
+
+// Simulated clock, in minutes after 11:00am. It only moves forward: every
+// role advances it with clock_advance(), an atomic fetch-max, so concurrent
+// advances cannot lose an update and none of them needs a lock. The whole
+// state is one word, so a plain atomic load is always a consistent read.
+typedef struct {
+    _Atomic int minute;
+} sim_clock_t;
+
+// Fixed head of the shared memory segment. Every region that a different
+// set of processes writes starts on its own cache line.
+typedef struct {
+    // Written once by the creator, checked by every attach
+    struct {
+        unsigned magic;
+        unsigned version;
+        unsigned size;
+    } header CACHE_ALIGNED;
+    
+    config_t config;
+    layout_t layout;
+    
+    // Processes forked so far by the cook and waiter parents, each after it
+    // joined the virtual clock. A driver that starts the customers polls this
+    // until the whole staff is in, so the clock cannot run ahead of them.
+    struct {
+        _Atomic int cooks;
+        _Atomic int waiters;
+    } staffed;
+    
+    sim_clock_t clock CACHE_ALIGNED;
+    
+    struct {
+        int empty_tables;
+        int next_waiter;                 // Next waiter to serve
+        unsigned rng;                    // Random state for ASSIGN_TWO_CHOICES
+    } tables CACHE_ALIGNED;
+    
+    _Atomic int pending_orders CACHE_ALIGNED;   // Orders (dishes, with stations) queued for cooks
+    
+    // Kitchen credits, one per cook ring slot, under KITCHEN_SEM
+    struct {
+        int free;
+        int blocked;                     // Waiters queued for a credit (KITCHEN_BLOCKED)
+        int head;                        // Oldest of them
+    } credits;
+    
+    // Kitchen stations after the first. A cook reserves a slot in the next
+    // station's queue before handing a dish on; below zero, cooks are waiting
+    // on STATION_SPACE_SEM for one. Orders count from seating until plated,
+    // so the later stations know when the kitchen is done for the day.
+    struct {
+        _Atomic int space[MAX_STATIONS];
+        _Atomic int open_orders;
+    } pipeline CACHE_ALIGNED;
+    
+    // Session statistics, in simulated minutes. Each role adds only to its
+    // own block, so customers, waiters and cooks never contend for a line.
+    struct {
+        struct {
+            latency_hist_t stages[NUM_STAGES];   // Folded in as each customer leaves
+            latency_hist_t food;         // Seated -> food served
+            _Atomic int arrived;         // Customers who came while open
+            _Atomic int turned_away;     // ... and left without a table or a waiter
+            _Atomic int rejected;        // Orders refused by a full waiter queue
+        } customers CACHE_ALIGNED;
+        
+        struct {
+            _Atomic long busy;           // Minutes spent taking orders, all waiters
+            _Atomic int stolen;          // Orders taken by a waiter they were not assigned to
+            _Atomic int kitchen_high;    // Most orders (dishes) queued for cooks at once
+            _Atomic int kitchen_blocks;  // Times a waiter found no kitchen credit
+            _Atomic long kitchen_blocked;   // Minutes waiters spent blocked for one
+        } waiters CACHE_ALIGNED;
+        
+        struct {
+            _Atomic long busy;           // Minutes spent cooking, all cooks
+            _Atomic long station_busy[MAX_STATIONS];   // Minutes worked at each station
+            _Atomic long station_done[MAX_STATIONS];   // Dishes (orders, when plating) finished
+            _Atomic long batches;        // Batches of two or more dishes
+            _Atomic long batched;        // Dishes made in them
+            _Atomic long batch_saved;    // Cook minutes saved over making them singly
+        } cooks CACHE_ALIGNED;
+    } stats;
+} shared_t;
+
+#define SHM_REGION(shm, off) ((void *)((char *)(shm) + (off)))
+
+// Convenience macros for accessing shared memory
+#define EMPTY_TABLES(shm) ((shm)->tables.empty_tables)
+#define NEXT_WAITER(shm) ((shm)->tables.next_waiter)
+#define PENDING_ORDERS(shm) ((shm)->pending_orders)
+#define FREE_SEATS(shm) ((int *)SHM_REGION(shm, (shm)->layout.seats))
+#define LIFECYCLE(shm, s) ((lifecycle_t *)SHM_REGION(shm, (shm)->layout.lifecycle) + (s))
+
+#define WAITER_AREA(shm, w) \
+    ((waiter_area_t *)SHM_REGION(shm, (shm)->layout.waiters + (w) * (shm)->layout.waiter_stride))
+#define WAITER_PENDING_ORDERS(shm, w) (WAITER_AREA(shm, w)->pending_orders)
+
+// Order rings: one MPSC ring per waiter (customers -> waiter), one MPSC
+// food-ready mailbox per waiter (cooks -> waiter) and the MPMC cook ring
+// (waiters -> cooks)
+#define WAITER_RING(shm, w) ((order_ring_t *)(WAITER_AREA(shm, w) + 1))
+#define WAITER_MAILBOX(shm, w) \
+    ((order_ring_t *)((char *)WAITER_RING(shm, w) + RING_BYTES((shm)->config.queue_size)))
+#define COOK_RING(shm) ((order_ring_t *)SHM_REGION(shm, (shm)->layout.cook_ring))
+#define KITCHEN_HEAP(shm) ((kitchen_heap_t *)SHM_REGION(shm, (shm)->layout.kitchen))
+#define STATION_RING(shm, s) \
+    ((order_ring_t *)SHM_REGION(shm, (shm)->layout.stations + ((s) - 1) * RING_BYTES((shm)->config.queue_size)))
+#define KITCHEN_BLOCKED(shm) ((int *)SHM_REGION(shm, (shm)->layout.blocked))
+#define STATION_SPACE(shm, s) ((shm)->pipeline.space[s])
+#define OPEN_ORDERS(shm) ((shm)->pipeline.open_orders)
+#define KITCHEN_TICKET(shm, seat) ((_Atomic int *)SHM_REGION(shm, (shm)->layout.tickets) + (seat))
+#define EVENT_RINGS(c) ((c)->cooks + (c)->waiters + 1)
+#define EVENT_RING(shm, i) ((event_ring_t *)SHM_REGION(shm, (shm)->layout.events + (i) * EVENT_RING_BYTES))
+
+#define DECISION_LOG(shm) ((decision_log_t *)SHM_REGION(shm, (shm)->layout.decisions))
+#define VCLOCK(shm) ((vclock_t *)SHM_REGION(shm, (shm)->layout.vclock))
+#define VCLOCK_ENABLED(shm) (VCLOCK(shm)->enabled)
+#define VCLOCK_TOKENS(shm) ((int *)(VCLOCK(shm) + 1))   // Posts not yet consumed
+#define VCLOCK_WAITERS(shm) (VCLOCK_TOKENS(shm) + TOTAL_SEMS(shm))   // Blocked in wait_event()
+#define VCLOCK_HEAP(shm) ((vclock_event_t *)(VCLOCK_WAITERS(shm) + TOTAL_SEMS(shm)))
+
+#define SHM_SIZE(shm) ((shm)->layout.size)
+
+static inline int clock_now(shared_t *shm) {
+    return atomic_load_explicit(&shm->clock.minute, memory_order_acquire);
+}
+
+// Move the clock forward to minute; an earlier minute leaves it unchanged
+static inline void clock_advance(shared_t *shm, int minute) {
+    int now = atomic_load_explicit(&shm->clock.minute, memory_order_relaxed);
+    while (minute > now &&
+           !atomic_compare_exchange_weak_explicit(&shm->clock.minute, &now, minute,
+                                                  memory_order_release, memory_order_relaxed)) {
+    }
+}
+
+// Past closing time no customer is seated; roles drain what is left
+static inline int restaurant_closed(shared_t *shm) {
+    return clock_now(shm) >= CLOSING_TIME;
+}
+
+// Kitchen stations after the first; the first is fed by the cook ring and
+// woken through COOK_SEM, the others have their own ring and semaphore
+static inline int later_stations(const config_t *config) {
+    return config->stations > 0 ? config->stations - 1 : 0;
+}
+
+// Number of semaphores a configuration needs
+static inline int config_sems(const config_t *config) {
+    return FIXED_SEMS + config->cooks + config->waiters + 2 + config->waiters + config->tables +
+           2 * later_stations(config);
+}
+
+// Compute where each region lives for a given configuration
+static inline void layout_init(layout_t *layout, const config_t *config) {
+    int nsems = config_sems(config);
+    size_t off = sizeof(shared_t);
+    
+    layout->seats = off;
+    off += ALIGN_UP(config->tables * sizeof(int));
+    
+    layout->lifecycle = off;
+    off += ALIGN_UP(config->tables * sizeof(lifecycle_t));
+    
+    // Each seated customer has at most one order in flight, so a mailbox
+    // holding one entry per table never fills and cooks never wait on it
+    layout->mailbox_size = 2;
+    while (layout->mailbox_size < config->tables) layout->mailbox_size *= 2;
+    
+    layout->waiters = off;
+    layout->waiter_stride = sizeof(waiter_area_t) + RING_BYTES(config->queue_size) +
+                            RING_BYTES(layout->mailbox_size);
+    off += config->waiters * layout->waiter_stride;
+    
+    layout->cook_ring = off;
+    off += RING_BYTES(config->queue_size);
+    
+    layout->kitchen = off;
+    off += ALIGN_UP(sizeof(kitchen_heap_t) + config->queue_size * sizeof(order_t));
+    
+    layout->stations = off;
+    off += later_stations(config) * RING_BYTES(config->queue_size);
+    
+    layout->tickets = off;
+    if (config->stations > 0) {
+        off += ALIGN_UP(config->tables * sizeof(_Atomic int));
+    }
+    
+    layout->blocked = off;
+    off += ALIGN_UP(config->waiters * sizeof(int));
+    
+    layout->events = off;
+    if (config->event_log) {
+        off += EVENT_RINGS(config) * EVENT_RING_BYTES;
+    }
+    
+    layout->decisions = off;
+    if (config->decisions != DECISIONS_OFF) {
+        off += ALIGN_UP(sizeof(decision_log_t) + config->decision_capacity * sizeof(decision_t));
+    }
+    
+    layout->vclock = off;
+    off += ALIGN_UP(sizeof(vclock_t) + 2 * nsems * sizeof(int) +
+                    VCLOCK_HEAP_CAP(config) * sizeof(vclock_event_t));
+    
+    layout->size = off;
+}
+
+// Station a cook works at, -1 without stations. Cooks are numbered
+// station by station in chain order.
+static inline int cook_station(const config_t *config, int cook_id) {
+    for (int s = 0; s < config->stations; s++) {
+        if (cook_id < config->station_cooks[s]) return s;
+        cook_id -= config->station_cooks[s];
+    }
+    return -1;
+}
+
+// Dish an entry stands for. Traces only give party sizes, so each guest's
+// dish is a fixed hash of the customer and the guest: the same every run.
+static inline int order_dish(const order_t *order) {
+    unsigned h = (unsigned)order->customer_id * 2654435761u ^ (unsigned)order->item * 40503u;
+    return (h >> 16) % NUM_DISHES;
+}
+
+// Station a dish moves to after station s. Stations where it takes no time
+// are skipped; the plate station at the end takes every dish.
+static inline int next_station(const config_t *config, int s, int dish) {
+    while (++s < config->stations - 1 && menu[dish].minutes[config->station_kind[s]] == 0) {
+    }
+    return s;
+}
+
+// Attach to the shared segment, refusing one laid out by a different build
+static inline shared_t *attach_shared_memory(int shmid) {
+    struct shmid_ds ds;
+    if (shmctl(shmid, IPC_STAT, &ds) == -1) {
+        perror("shmctl");
         exit(1);
     }
+    
+    shared_t *shm = (shared_t *)shmat(shmid, NULL, 0);
+    if (shm == (void *) -1) {
+        perror("shmat");
+        exit(1);
+    }
+    
+    if (ds.shm_segsz < sizeof(shared_t) || shm->header.magic != SHM_MAGIC ||
+        shm->header.version != SHM_VERSION || shm->header.size != ds.shm_segsz) {
+        fprintf(stderr, "Shared memory layout mismatch (magic %#x version %u, "
+                "expected %#x version %u)\n",
+                shm->header.magic, shm->header.version, SHM_MAGIC, SHM_VERSION);
+        shmdt(shm);
+        exit(1);
+    }
+    
+    // Publish telemetry too if this session has a segment for it
+    if (telemetry == NULL) {
+        telemetry = telemetry_attach(0);
+    }
+    return shm;
+}
+
+// queue_size must be a power of two and at least 2: with one slot, a
+// filled slot's seq (pos + 1) equals the next pos, so it reads as free
+static inline void ring_init(order_ring_t *ring, int queue_size) {
+    ring->mask = queue_size - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    for (unsigned i = 0; i < (unsigned)queue_size; i++) {
+        atomic_init(&ring->slots[i].seq, i);
+    }
+}
+
+// Multi-producer enqueue. Returns 0 if the ring is full.
+static inline int ring_push(order_ring_t *ring, const order_t *order) {
+    unsigned pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    ring_slot_t *slot;
+    
+    while (1) {
+        slot = &ring->slots[pos & ring->mask];
+        unsigned seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        int dif = (int)(seq - pos);
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring->tail, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (dif < 0) {
+            return 0;  // Slot still holds an entry from the previous lap
+        } else {
+            pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        }
+    }
+    
+    slot->order = *order;
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    return 1;
+}
+
+// Multi-consumer dequeue. Returns 0 if the ring is empty.
+static inline int ring_pop(order_ring_t *ring, order_t *order) {
+    unsigned pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    ring_slot_t *slot;
+    
+    while (1) {
+        slot = &ring->slots[pos & ring->mask];
+        unsigned seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        int dif = (int)(seq - (pos + 1));
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring->head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (dif < 0) {
+            return 0;
+        } else {
+            pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        }
+    }
+    
+    *order = slot->order;
+    atomic_store_explicit(&slot->seq, pos + ring->mask + 1, memory_order_release);
+    return 1;
+}
+
+// Single-consumer dequeue: only the owning waiter pops its ring, so the
+// head can be advanced with a plain store.
+static inline int ring_pop_single(order_ring_t *ring, order_t *order) {
+    unsigned pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    ring_slot_t *slot = &ring->slots[pos & ring->mask];
+    
+    if (atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + 1) {
+        return 0;
+    }
+    *order = slot->order;
+    atomic_store_explicit(&ring->head, pos + 1, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, pos + ring->mask + 1, memory_order_release);
+    return 1;
+}
+
+// Pick a waiter for a newly seated customer. Must be called with TABLES_SEM held.
+static inline int assign_waiter(shared_t *shm) {
+    int n = shm->config.waiters;
+    int w = NEXT_WAITER(shm);
+    
+    switch (shm->config.assign_policy) {
+    case ASSIGN_LEAST_PENDING:
+        for (int i = 1; i < n; i++) {
+            int v = (NEXT_WAITER(shm) + i) % n;
+            if (atomic_load(&WAITER_PENDING_ORDERS(shm, v)) < atomic_load(&WAITER_PENDING_ORDERS(shm, w))) {
+                w = v;
+            }
+        }
+        break;
+    case ASSIGN_TWO_CHOICES: {
+        // xorshift32, kept in shared memory so runs are repeatable
+        unsigned x = shm->tables.rng;
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        shm->tables.rng = x;
+        int a = x % n;
+        int b = (x / n) % n;
+        w = (atomic_load(&WAITER_PENDING_ORDERS(shm, b)) < atomic_load(&WAITER_PENDING_ORDERS(shm, a))) ? b : a;
+        break;
+    }
+    default:
+        break;
+    }
+    
+    NEXT_WAITER(shm) = (w + 1) % n;
+    return w;
 }
 
-static void put(int semid, int sem_num) {
-    struct sembuf sb;
-    sb.sem_num = sem_num;
-    sb.sem_op = 1;
-    sb.sem_flg = 0;
-    if (semop(semid, &sb, 1) == -1) {
-        perror("semop: put");
+static inline int ring_empty(order_ring_t *ring) {
+    unsigned pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    return atomic_load_explicit(&ring->slots[pos & ring->mask].seq, memory_order_acquire) != pos + 1;
+}
+
+// Report a role event: into the producer's ring when the event log is on,
+// otherwise printed straight away as before. role is the cook or waiter id.
+static inline void log_event(shared_t *shm, int type, int role, int a, int b, int c) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    event_t ev = { (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec, clock_now(shm),
+                   type, role, a, b, c, 0 };
+    
+    if (!shm->config.event_log) {
+        char line[128];
+        format_event(&ev, line, sizeof(line));
+        puts(line);
+        return;
+    }
+    
+    int ring;
+    if (type <= EV_COOK_TERMINATED) ring = role;
+    else if (type <= EV_WAITER_TERMINATED) ring = shm->config.cooks + role;
+    else ring = shm->config.cooks + shm->config.waiters;
+    event_push(EVENT_RING(shm, ring), &ev);
+}
+
+// Queue a customer's order with order->waiter_id. Returns 0 if the queue is full.
+static inline int add_waiter_request(shared_t *shm, const order_t *order) {
+    atomic_fetch_add(&WAITER_PENDING_ORDERS(shm, order->waiter_id), 1);
+    telemetry_pending(order->waiter_id, 1);
+    if (!ring_push(WAITER_RING(shm, order->waiter_id), order)) {
+        atomic_fetch_sub(&WAITER_PENDING_ORDERS(shm, order->waiter_id), 1);
+        telemetry_pending(order->waiter_id, -1);
+        return 0;
+    }
+    return 1;
+}
+
+// Waiter queues are popped with the multi-consumer ring_pop() because idle
+// waiters may steal from them
+static inline int get_waiter_request(shared_t *shm, int waiter_id, order_t *order) {
+    if (!ring_pop(WAITER_RING(shm, waiter_id), order)) {
+        return 0;
+    }
+    atomic_fetch_sub(&WAITER_PENDING_ORDERS(shm, waiter_id), 1);
+    telemetry_pending(waiter_id, -1);
+    return 1;
+}
+
+// Take the oldest order from the waiter with the largest backlog. The order
+// is re-addressed so its food comes back to the thief.
+static inline int steal_waiter_request(shared_t *shm, int thief, order_t *order) {
+    int victim = -1, most = 0;
+    for (int v = 0; v < shm->config.waiters; v++) {
+        int pending = atomic_load(&WAITER_PENDING_ORDERS(shm, v));
+        if (v != thief && pending > most) {
+            victim = v;
+            most = pending;
+        }
+    }
+    if (victim == -1 || !get_waiter_request(shm, victim, order)) {
+        return 0;
+    }
+    order->waiter_id = thief;
+    atomic_fetch_add(&shm->stats.waiters.stolen, 1);
+    return 1;
+}
+
+// Bucket holding a latency of minutes (>= 0)
+static inline int latency_bucket(int minutes) {
+    if (minutes < 2 << LATENCY_SUB_BITS) return minutes;
+    int shift = 31 - __builtin_clz(minutes) - LATENCY_SUB_BITS;
+    return (shift << LATENCY_SUB_BITS) + (minutes >> shift);
+}
+
+// Largest latency that falls in bucket i
+static inline int latency_bucket_max(int i) {
+    if (i < 2 << LATENCY_SUB_BITS) return i;
+    int shift = (i >> LATENCY_SUB_BITS) - 1;
+    long top = ((long)(i - (shift << LATENCY_SUB_BITS)) + 1) << shift;
+    return top - 1 > INT_MAX ? INT_MAX : (int)(top - 1);
+}
+
+static inline void record_latency(latency_hist_t *hist, int minutes) {
+    if (minutes < 0) minutes = 0;
+    atomic_fetch_add(&hist->count, 1);
+    atomic_fetch_add(&hist->total, minutes);
+    
+    int max = atomic_load(&hist->max);
+    while (minutes > max && !atomic_compare_exchange_weak(&hist->max, &max, minutes)) {
+    }
+    
+    atomic_fetch_add(&hist->buckets[latency_bucket(minutes)], 1);
+}
+
+// Fold the stamps of the customer leaving a seat into the stage histograms.
+// Must be called before the seat is returned to the free stack.
+static inline void record_lifecycle(shared_t *shm, int seat) {
+    lifecycle_t *lc = LIFECYCLE(shm, seat);
+    record_latency(&shm->stats.customers.stages[STAGE_SEATING], lc->seated - lc->arrived);
+    record_latency(&shm->stats.customers.stages[STAGE_ORDER], lc->order_taken - lc->seated);
+    record_latency(&shm->stats.customers.stages[STAGE_KITCHEN], lc->cook_start - lc->order_taken);
+    record_latency(&shm->stats.customers.stages[STAGE_SERVICE], lc->served - lc->cook_start);
+    record_latency(&shm->stats.customers.stages[STAGE_DINING], clock_now(shm) - lc->served);
+}
+
+static inline double latency_mean(latency_hist_t *hist) {
+    int count = atomic_load(&hist->count);
+    return count ? (double)atomic_load(&hist->total) / count : 0.0;
+}
+
+// Smallest minute at or below which pct percent of the samples fall
+// Upper bound of the bucket holding the percentile, never above the
+// largest latency recorded
+static inline int latency_percentile(latency_hist_t *hist, int pct) {
+    int count = atomic_load(&hist->count);
+    int max = atomic_load(&hist->max);
+    long seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += atomic_load(&hist->buckets[i]);
+        if (seen * 100 >= (long)count * pct) {
+            int top = latency_bucket_max(i);
+            return top < max ? top : max;
+        }
+    }
+    return max;
+}
+
+// End-of-session summary used to compare assignment and kitchen policies
+static inline void print_session_stats(shared_t *shm) {
+    latency_hist_t *take = &shm->stats.customers.stages[STAGE_ORDER];
+    latency_hist_t *food = &shm->stats.customers.food;
+    
+    printf("Order-taking latency (%s%s): %d orders, mean %.2f min, p99 %d min, %d stolen\n",
+           assign_policy_names[shm->config.assign_policy],
+           shm->config.steal ? ", stealing" : "", atomic_load(&take->count),
+           latency_mean(take), latency_percentile(take, 99),
+           atomic_load(&shm->stats.waiters.stolen));
+    printf("Time to food (%s): %d served, mean %.2f min, p99 %d min, table turnover %.2f\n",
+           kitchen_policy_names[shm->config.kitchen_policy], atomic_load(&food->count),
+           latency_mean(food), latency_percentile(food, 99),
+           (double)atomic_load(&food->count) / shm->config.tables);
+    
+    // The busiest station is the kitchen's bottleneck
+    int minutes = clock_now(shm) > 0 ? clock_now(shm) : 1;
+    for (int s = 0; s < shm->config.stations; s++) {
+        int kind = shm->config.station_kind[s];
+        printf("Station %d (%s, %d cooks): %ld %s, %.1f%% busy\n", s, station_kind_names[kind],
+               shm->config.station_cooks[s], atomic_load(&shm->stats.cooks.station_done[s]),
+               kind == STATION_PLATE ? "orders plated" : "dishes",
+               100.0 * atomic_load(&shm->stats.cooks.station_busy[s]) /
+               ((long)shm->config.station_cooks[s] * minutes));
+    }
+    
+    // Backpressure: a full kitchen blocks waiters, whose queues then fill
+    // and turn customers away
+    printf("Kitchen queue (capacity %d): high-water %d, waiters blocked %d times for %ld min, "
+           "%d orders rejected by full waiter queues\n", shm->config.queue_size,
+           atomic_load(&shm->stats.waiters.kitchen_high),
+           atomic_load(&shm->stats.waiters.kitchen_blocks),
+           atomic_load(&shm->stats.waiters.kitchen_blocked),
+           atomic_load(&shm->stats.customers.rejected));
+    
+    // Saved minutes are capacity the batching station gained: the same
+    // dishes done singly would have kept it busy for busy + saved minutes
+    if (shm->config.batch_max > 1) {
+        long batches = atomic_load(&shm->stats.cooks.batches);
+        long saved = atomic_load(&shm->stats.cooks.batch_saved);
+        long busy = atomic_load(&shm->stats.cooks.station_busy[0]);
+        printf("Batching (up to %d, hold %d min, +%d%% per portion): %ld batches, "
+               "%.2f dishes each, %ld cook minutes saved, %.1f%% more dishes per busy minute\n",
+               shm->config.batch_max, shm->config.batch_wait, shm->config.batch_extra, batches,
+               batches ? (double)atomic_load(&shm->stats.cooks.batched) / batches : 0.0, saved,
+               busy ? 100.0 * saved / busy : 0.0);
+    }
+}
+
+// Minutes a batch of n portions of a dish takes at a station where one
+// portion takes `minutes`: extra portions are rounded up to whole minutes
+static inline int batch_minutes(const config_t *config, int minutes, int n) {
+    return minutes + ((n - 1) * minutes * config->batch_extra + 99) / 100;
+}
+
+// Take a kitchen credit for one cook queue entry. Returns 0 if there was
+// none: the waiter is then queued for the next credit a cook frees and must
+// wait_event() on its timer semaphore, after which it holds that credit.
+// Credits go to blocked waiters in the order they asked, so a replay hands
+// them out as the recording did.
+static inline int kitchen_take_credit(shared_t *shm, int semid, int waiter_id) {
+    int taken = 1;
+    take_lock(semid, KITCHEN_SEM);
+    if (shm->credits.free > 0) {
+        shm->credits.free--;
+    } else {
+        int tail = (shm->credits.head + shm->credits.blocked++) % shm->config.waiters;
+        KITCHEN_BLOCKED(shm)[tail] = waiter_id;
+        taken = 0;
+    }
+    put(semid, KITCHEN_SEM);
+    
+    if (!taken) {
+        atomic_fetch_add(&shm->stats.waiters.kitchen_blocks, 1);
+    }
+    return taken;
+}
+
+// Queue an order for the kitchen; with stations, queue its next dish. The
+// caller holds a kitchen credit for the entry, so the cook ring has room.
+// Returns 1 once the whole order is queued.
+static inline int add_cooking_request(shared_t *shm, order_t *order) {
+    if (shm->config.stations > 0 && order->item == 0) {
+        atomic_store(KITCHEN_TICKET(shm, order->seat), order->count);
+    }
+    
+    int pending = atomic_fetch_add(&PENDING_ORDERS(shm), 1) + 1;
+    telemetry_pending(-1, 1);
+    _Atomic int *kitchen_high = &shm->stats.waiters.kitchen_high;
+    int high = atomic_load(kitchen_high);
+    while (pending > high && !atomic_compare_exchange_weak(kitchen_high, &high, pending)) {
+    }
+    
+    if (!ring_push(COOK_RING(shm), order)) {
+        fprintf(stderr, "cook ring overflowed with kitchen credits held\n");
         exit(1);
     }
+    return shm->config.stations == 0 || ++order->item == order->count;
 }
 
-// Common function to get IPC keys
-static key_t get_key() {
-    key_t key = ftok("/tmp", PROJ_ID);
-    if (key == -1) {
-        perror("ftok");
+// Heap key of an order under the session's kitchen policy; lower cooks first
+static inline int kitchen_key(shared_t *shm, const order_t *order) {
+    switch (shm->config.kitchen_policy) {
+    case KITCHEN_SJF:
+        return order->count;
+    case KITCHEN_DEADLINE:
+        // Every minute spent waiting counts as much as a minute of cook
+        // time, so a large party eventually overtakes newer small ones
+        return order->queued_at + order->count * COOK_MINUTES_PER_PERSON;
+    default:
+        return 0;
+    }
+}
+
+// Ties go to the customer seated first, then to an order's first dish
+static inline int kitchen_before(shared_t *shm, const order_t *a, const order_t *b) {
+    int ka = kitchen_key(shm, a), kb = kitchen_key(shm, b);
+    return ka < kb || (ka == kb && (a->queued_at < b->queued_at ||
+                                    (a->queued_at == b->queued_at && a->item < b->item)));
+}
+
+static inline void kitchen_push(shared_t *shm, const order_t *order) {
+    kitchen_heap_t *heap = KITCHEN_HEAP(shm);
+    int i = heap->size++;
+    while (i > 0 && kitchen_before(shm, order, &heap->orders[(i - 1) / 2])) {
+        heap->orders[i] = heap->orders[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap->orders[i] = *order;
+}
+
+// Place order at slot i or below it
+static inline void kitchen_sift_down(shared_t *shm, int i, order_t order) {
+    kitchen_heap_t *heap = KITCHEN_HEAP(shm);
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= heap->size) break;
+        if (child + 1 < heap->size && kitchen_before(shm, &heap->orders[child + 1], &heap->orders[child])) child++;
+        if (!kitchen_before(shm, &heap->orders[child], &order)) break;
+        heap->orders[i] = heap->orders[child];
+        i = child;
+    }
+    heap->orders[i] = order;
+}
+
+static inline void kitchen_pop(shared_t *shm, order_t *order) {
+    kitchen_heap_t *heap = KITCHEN_HEAP(shm);
+    *order = heap->orders[0];
+    heap->size--;
+    kitchen_sift_down(shm, 0, heap->orders[heap->size]);
+}
+
+// Move everything queued on the cook ring into the kitchen heap. Must be
+// called with KITCHEN_SEM held.
+static inline void kitchen_fill(shared_t *shm) {
+    kitchen_heap_t *heap = KITCHEN_HEAP(shm);
+    order_t queued;
+    while (heap->size < shm->config.queue_size && ring_pop(COOK_RING(shm), &queued)) {
+        kitchen_push(shm, &queued);
+    }
+}
+
+// Pick the next order to cook. FIFO pops the cook ring directly; the other
+// policies, and batching, which needs to see every queued dish, move
+// everything queued on the ring into the kitchen heap and take its best order.
+static inline int get_cooking_request(shared_t *shm, int semid, order_t *order) {
+    if (shm->config.kitchen_policy == KITCHEN_FIFO && shm->config.batch_max <= 1) {
+        if (!ring_pop(COOK_RING(shm), order)) {
+            return 0;
+        }
+        atomic_fetch_sub(&PENDING_ORDERS(shm), 1);
+        telemetry_pending(-1, -1);
+        return 1;
+    }
+    
+    kitchen_heap_t *heap = KITCHEN_HEAP(shm);
+    int found = 0;
+    
+    take_lock(semid, KITCHEN_SEM);
+    kitchen_fill(shm);
+    if (heap->size > 0) {
+        kitchen_pop(shm, order);
+        found = 1;
+    }
+    put(semid, KITCHEN_SEM);
+    
+    if (found) {
+        atomic_fetch_sub(&PENDING_ORDERS(shm), 1);
+        telemetry_pending(-1, -1);
+    }
+    return found;
+}
+
+// Take up to room queued dishes of kind dish into batch, best first under
+// the kitchen policy. Returns how many were taken.
+static inline int get_cooking_batch(shared_t *shm, int semid, int dish, order_t *batch, int room) {
+    kitchen_heap_t *heap = KITCHEN_HEAP(shm);
+    int taken = 0;
+    
+    take_lock(semid, KITCHEN_SEM);
+    kitchen_fill(shm);
+    while (taken < room) {
+        // Best matching dish; the heap is small, so a scan is cheap
+        int best = -1;
+        for (int i = 0; i < heap->size; i++) {
+            if (order_dish(&heap->orders[i]) == dish &&
+                (best == -1 || kitchen_before(shm, &heap->orders[i], &heap->orders[best]))) {
+                best = i;
+            }
+        }
+        if (best == -1) break;
+        batch[taken++] = heap->orders[best];
+        
+        // Refill the hole with the last order and restore the heap around it
+        order_t last = heap->orders[--heap->size];
+        if (best == heap->size) continue;
+        int i = best;
+        while (i > 0 && kitchen_before(shm, &last, &heap->orders[(i - 1) / 2])) {
+            heap->orders[i] = heap->orders[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        kitchen_sift_down(shm, i, last);
+    }
+    put(semid, KITCHEN_SEM);
+    
+    if (taken > 0) {
+        atomic_fetch_sub(&PENDING_ORDERS(shm), taken);
+        telemetry_pending(-1, -taken);
+    }
+    return taken;
+}
+
+// Hand a cooked order to its waiter. The mailbox is sized so this cannot fail.
+static inline void add_food_ready(shared_t *shm, const order_t *order) {
+    if (!ring_push(WAITER_MAILBOX(shm, order->waiter_id), order)) {
+        fprintf(stderr, "food-ready mailbox of waiter %d overflowed\n", order->waiter_id);
         exit(1);
     }
-    return key;
 }
 
-static void add_cooking_request(int *shm, int waiter_id, int customer_id, int count) {
-    int rear = shm[COOK_REAR];
-    shm[COOK_QUEUE_DATA + rear*3] = waiter_id;
-    shm[COOK_QUEUE_DATA + rear*3 + 1] = customer_id;
-    shm[COOK_QUEUE_DATA + rear*3 + 2] = count;
-    shm[COOK_REAR] = (rear + 1) % QUEUE_SIZE;
-    PENDING_ORDERS(shm)++;
+static inline int get_food_ready(shared_t *shm, int waiter_id, order_t *order) {
+    return ring_pop_single(WAITER_MAILBOX(shm, waiter_id), order);
+}
+
+// Stop the session: the replay no longer matches the recording. Removes
+// the IPC objects like the roles' signal handlers, so every role exits.
+static inline void decision_diverged(shared_t *shm, int semid, unsigned long turn, const char *why) {
+    decision_log_t *log = DECISION_LOG(shm);
+    atomic_store(&log->diverged, 1);
+    if (turn < log->count) {
+        decision_t *d = &log->records[turn];
+        fprintf(stderr, "Replay diverged at decision %lu (%s by actor %u at minute %u): %s\n",
+                turn, decision_names[d->kind], d->actor, d->minute, why);
+    } else {
+        fprintf(stderr, "Replay diverged at decision %lu: %s\n", turn, why);
+    }
+    
+    int shmid = shmget(get_key(), 0, 0);
+    if (shmid != -1) shmctl(shmid, IPC_RMID, NULL);
+    telemetry_remove();
+    semset_remove(semid);
+    exit(1);
+}
+
+// On replay the clock may not pass the minute of the next recorded
+// decision, or a section parked waiting for its turn would run late
+static inline int decision_horizon(shared_t *shm) {
+    if (shm->config.decisions != DECISIONS_REPLAY) return INT_MAX;
+    decision_log_t *log = DECISION_LOG(shm);
+    unsigned long turn = atomic_load(&log->turn);
+    return turn < log->count ? log->records[turn].minute : INT_MAX;
+}
+
+// Calendar order: by minute, then by booking order
+static inline int vclock_before(const vclock_event_t *a, const vclock_event_t *b) {
+    return a->when < b->when || (a->when == b->when && (int)(a->seq - b->seq) < 0);
+}
+
+// Virtual clock: pop the earliest wakeup once every participant is blocked.
+// Must be called with CLOCK_SEM held.
+static inline void vclock_advance(shared_t *shm, int semid) {
+    vclock_t *vc = VCLOCK(shm);
+    vclock_event_t *heap = VCLOCK_HEAP(shm);
+    
+    while (vc->runnable == 0 && vc->heap_size > 0) {
+        if (heap[0].when > decision_horizon(shm)) {
+            // Only a parked role can run the next decision; with none, the
+            // roles took a path the recording does not have
+            decision_log_t *log = DECISION_LOG(shm);
+            if (atomic_load(&log->parked) == 0) {
+                decision_diverged(shm, semid, atomic_load(&log->turn), "no role can reach this decision");
+            }
+            break;
+        }
+        
+        vclock_event_t next = heap[0];
+        
+        // Move the last entry to the root and sift it down
+        vclock_event_t last = heap[--vc->heap_size];
+        int i = 0;
+        while (1) {
+            int child = 2 * i + 1;
+            if (child >= vc->heap_size) break;
+            if (child + 1 < vc->heap_size && vclock_before(&heap[child + 1], &heap[child])) child++;
+            if (!vclock_before(&heap[child], &last)) break;
+            heap[i] = heap[child];
+            i = child;
+        }
+        heap[i] = last;
+        
+        clock_advance(shm, next.when);
+        vc->runnable++;
+        put(semid, next.sem);
+    }
+}
+
+// Register a participant with the virtual clock. Called by the parent
+// before fork() so the clock cannot jump before the child starts.
+static inline void vclock_join(shared_t *shm, int semid) {
+    if (!VCLOCK_ENABLED(shm)) return;
+    take_lock(semid, CLOCK_SEM);
+    VCLOCK(shm)->runnable++;
+    put(semid, CLOCK_SEM);
+}
+
+// Deregister a participant that is about to exit
+static inline void vclock_leave(shared_t *shm, int semid) {
+    if (!VCLOCK_ENABLED(shm)) return;
+    take_lock(semid, CLOCK_SEM);
+    VCLOCK(shm)->runnable--;
+    vclock_advance(shm, semid);
+    put(semid, CLOCK_SEM);
+}
+
+// Block until another role signals sem
+static inline void wait_event(shared_t *shm, int semid, int sem) {
+    if (VCLOCK_ENABLED(shm)) {
+        vclock_t *vc = VCLOCK(shm);
+        take_lock(semid, CLOCK_SEM);
+        if (VCLOCK_TOKENS(shm)[sem] > 0) {
+            VCLOCK_TOKENS(shm)[sem]--;
+        } else {
+            VCLOCK_WAITERS(shm)[sem]++;
+            vc->runnable--;
+            vclock_advance(shm, semid);
+        }
+        put(semid, CLOCK_SEM);
+    }
+    take(semid, sem);
+}
+
+// Wake a role blocked in wait_event()
+static inline void signal_event(shared_t *shm, int semid, int sem) {
+    if (VCLOCK_ENABLED(shm)) {
+        vclock_t *vc = VCLOCK(shm);
+        take_lock(semid, CLOCK_SEM);
+        if (VCLOCK_WAITERS(shm)[sem] > 0) {
+            // Hand our runnable credit over to the wakee
+            VCLOCK_WAITERS(shm)[sem]--;
+            vc->runnable++;
+        } else {
+            VCLOCK_TOKENS(shm)[sem]++;
+        }
+        put(semid, CLOCK_SEM);
+    }
+    put(semid, sem);
+}
+
+// Give back kitchen credits for n entries a cook took off the queue,
+// handing each to the longest blocked waiter if there is one. A blocked
+// waiter is not sleeping on its timer, so its timer semaphore is free to
+// carry the wakeup.
+static inline void kitchen_release(shared_t *shm, int semid, int n) {
+    take_lock(semid, KITCHEN_SEM);
+    for (int i = 0; i < n; i++) {
+        if (shm->credits.blocked == 0) {
+            shm->credits.free++;
+            continue;
+        }
+        int waiter_id = KITCHEN_BLOCKED(shm)[shm->credits.head];
+        shm->credits.head = (shm->credits.head + 1) % shm->config.waiters;
+        shm->credits.blocked--;
+        signal_event(shm, semid, WAITER_TIMER_SEM(shm, waiter_id));
+    }
+    put(semid, KITCHEN_SEM);
+}
+
+// The kitchen is done for the day: wake every cook at a station after the
+// first, so each can see that and leave (see station_main in cook.c)
+static inline void wake_stations(shared_t *shm, int semid) {
+    for (int s = 1; s < shm->config.stations; s++) {
+        for (int i = 0; i < shm->config.station_cooks[s]; i++) {
+            signal_event(shm, semid, STATION_SEM(shm, s));
+        }
+    }
 }
 
-static void get_cooking_request(int *shm, int *waiter_id, int *customer_id, int *count) {
-    int front = shm[COOK_FRONT];
-    *waiter_id = shm[COOK_QUEUE_DATA + front*3];
-    *customer_id = shm[COOK_QUEUE_DATA + front*3 + 1];
-    *count = shm[COOK_QUEUE_DATA + front*3 + 2];
-    shm[COOK_FRONT] = (front + 1) % QUEUE_SIZE;
-    PENDING_ORDERS(shm)--;
+// An order has been plated or given up on. The last one after closing
+// time lets the later stations go.
+static inline void close_order(shared_t *shm, int semid) {
+    if (atomic_fetch_sub(&OPEN_ORDERS(shm), 1) == 1 && restaurant_closed(shm)) {
+        wake_stations(shm, semid);
+    }
+}
+
+// Park on wake_sem until the virtual clock reaches minute `when`
+static inline void vclock_sleep_until(shared_t *shm, int semid, int wake_sem, int when) {
+    vclock_t *vc = VCLOCK(shm);
+    vclock_event_t *heap = VCLOCK_HEAP(shm);
+    
+    take_lock(semid, CLOCK_SEM);
+    
+    // Insert (when, wake_sem) and sift it up
+    vclock_event_t event = { when, wake_sem, vc->next_seq++ };
+    int i = vc->heap_size++;
+    while (i > 0 && vclock_before(&event, &heap[(i - 1) / 2])) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = event;
+    
+    vc->runnable--;
+    vclock_advance(shm, semid);
+    put(semid, CLOCK_SEM);
+    
+    take(semid, wake_sem);
 }
 
 // Update simulated time
-static void update_time(int *shm, int minutes) {
-    int curr_time = TIME(shm);
+static inline void update_time(shared_t *shm, int semid, int wake_sem, int minutes) {
+    if (VCLOCK_ENABLED(shm)) {
+        vclock_sleep_until(shm, semid, wake_sem, clock_now(shm) + minutes);
+        return;
+    }
+    
+    int curr_time = clock_now(shm);
     usleep(minutes * 100000);  // Scale: 1 minute = 100ms
     
-    // Only update if new time is greater
-    if (curr_time + minutes > TIME(shm)) {
-        TIME(shm) = curr_time + minutes;
-    }
+    // Another role may have moved the clock further meanwhile
+    clock_advance(shm, curr_time + minutes);
 }
 
-#endif // IPC_SHARED_H
\ No newline at end of file
+#endif // IPC_SHARED_H
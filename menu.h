@@ -0,0 +1,33 @@
+#ifndef MENU_H
+#define MENU_H
+
+// Kinds of kitchen station a chain is built from (cook -S)
+enum {
+    STATION_PREP = 0,
+    STATION_COOK,
+    STATION_PLATE,
+    NUM_STATION_KINDS
+};
+
+static const char *const station_kind_names[NUM_STATION_KINDS] = {
+    "prep", "cook", "plate"
+};
+
+// The menu: minutes a dish spends at each kind of station. A dish skips
+// stations where it takes 0 minutes; plating is timed per order instead.
+// Dishes average COOK_MINUTES_PER_PERSON, like the whole-order kitchen.
+#define NUM_DISHES 4
+
+typedef struct {
+    const char *name;
+    int minutes[NUM_STATION_KINDS];
+} dish_t;
+
+static const dish_t menu[NUM_DISHES] = {
+    { "salad", { 3, 0, 0 } },
+    { "soup",  { 1, 3, 0 } },
+    { "pasta", { 2, 4, 0 } },
+    { "steak", { 1, 6, 0 } },
+};
+
+#endif // MENU_H
@@ -10,7 +10,7 @@ int semid = -1;
 void cleanup_handler(int sig) {
     printf("Restaurant process received signal %d, cleaning up...\n", sig);
     if (shmid != -1) shmctl(shmid, IPC_RMID, NULL);
-    if (semid != -1) semctl(semid, 0, IPC_RMID);
+    if (semid != -1) semset_remove(semid);
     exit(1);
 }
 
@@ -96,7 +96,7 @@ int main() {
         perror("shmctl");
     }
     
-    if (semctl(semid, 0, IPC_RMID) == -1) {
+    if (semset_remove(semid) == -1) {
         perror("semctl");
     }
     
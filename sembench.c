@@ -0,0 +1,102 @@
+#include "ipc_base.h"
+#include <time.h>
+
+// Semaphore micro-benchmark: drives orders through the same take/put
+// hand-off pattern the waiter and cook loops use and reports how many
+// semaphore system calls each order costs. Build with `make sembench`
+// (System V) and `make sembench FUTEX=1` (futex) and compare.
+//
+// Uses the simulation's IPC key, so do not run it during a session.
+
+enum { BENCH_MUTEX = 0, BENCH_COOK, BENCH_WAITER, BENCH_SEMS };
+
+static void report_syscalls(int fd) {
+    if (write(fd, &sem_syscalls, sizeof(sem_syscalls)) != sizeof(sem_syscalls)) {
+        perror("write");
+        exit(1);
+    }
+    close(fd);
+}
+
+int main(int argc, char *argv[]) {
+    int orders = (argc > 1) ? atoi(argv[1]) : 100000;
+    int window = (argc > 2) ? atoi(argv[2]) : 1;   // Orders in flight at once
+    if (orders <= 0 || window <= 0) {
+        fprintf(stderr, "Usage: %s [orders] [window]\n", argv[0]);
+        exit(1);
+    }
+    
+    int semid = semset_get(BENCH_SEMS, IPC_CREAT | 0666);
+    if (semid == -1) {
+        perror("semget");
+        exit(1);
+    }
+    unsigned short values[BENCH_SEMS] = { 1, 0, window };
+    if (semset_setall(semid, values) == -1) {
+        perror("semctl");
+        exit(1);
+    }
+    
+    int fds[2];
+    if (pipe(fds) == -1) {
+        perror("pipe");
+        exit(1);
+    }
+    
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    // Waiter: submit an order under the mutex, signal the kitchen and
+    // wait for a free slot in the window
+    pid_t waiter = fork();
+    if (waiter == 0) {
+        close(fds[0]);
+        for (int i = 0; i < orders; i++) {
+            take(semid, BENCH_WAITER);
+            take(semid, BENCH_MUTEX);
+            put(semid, BENCH_MUTEX);
+            put(semid, BENCH_COOK);
+        }
+        report_syscalls(fds[1]);
+        exit(0);
+    }
+    
+    // Cook: pick up each order under the mutex and hand it back
+    pid_t cook = fork();
+    if (cook == 0) {
+        close(fds[0]);
+        for (int i = 0; i < orders; i++) {
+            take(semid, BENCH_COOK);
+            take(semid, BENCH_MUTEX);
+            put(semid, BENCH_MUTEX);
+            put(semid, BENCH_WAITER);
+        }
+        report_syscalls(fds[1]);
+        exit(0);
+    }
+    
+    close(fds[1]);
+    waitpid(waiter, NULL, 0);
+    waitpid(cook, NULL, 0);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    
+    unsigned long total = 0, count;
+    while (read(fds[0], &count, sizeof(count)) == sizeof(count)) {
+        total += count;
+    }
+    close(fds[0]);
+    
+    if (semset_remove(semid) == -1) {
+        perror("semctl");
+    }
+    
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+#ifdef USE_FUTEX
+    const char *backend = "futex";
+#else
+    const char *backend = "sysv";
+#endif
+    printf("backend=%s orders=%d window=%d syscalls=%lu syscalls/order=%.2f ns/order=%.0f\n",
+           backend, orders, window, total, (double)total / orders, elapsed * 1e9 / orders);
+    return 0;
+}
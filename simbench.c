@@ -0,0 +1,196 @@
+#include "simdriver.h"
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+// End-to-end benchmark: generates canonical workloads, runs a full
+// cook/waiter/customer session on the virtual clock for each one and
+// records throughput, turn-aways, wall-clock time, context switches and
+// p99 time-to-food. Run it with `make bench`.
+//
+// Results go to a CSV with fixed columns and number formats, one row per
+// run and one mean row per workload, so two builds can be compared with diff.
+//
+// Runs under its own instance name unless $SIMUDINE_INSTANCE is set, so it
+// does not collide with a session started by hand.
+
+#define BENCH_DIR "bench.d"      // Scratch directory for traces and stats
+#define LAST_ARRIVAL 179         // Generated arrivals stop at closing time
+#define SESSION_TIMEOUT_MS 60000 // A session still running after this is killed
+
+typedef struct {
+    const char *name;
+    unsigned seed;
+    int max_gap;       // Minutes between arrivals are drawn from 0..max_gap
+    int burst;         // Customers arriving together at each arrival time
+    int min_party;
+    int max_party;
+} workload_t;
+
+static const workload_t workloads[] = {
+    { "light",     1, 20, 1, 1, 2 },
+    { "saturated", 2,  3, 1, 1, 4 },
+    { "bursty",    3, 30, 8, 1, 4 },
+    { "large",     4,  9, 1, 4, 8 },
+};
+#define NUM_WORKLOADS ((int)(sizeof(workloads) / sizeof(workloads[0])))
+
+typedef struct {
+    session_stats_t stats;
+    double wall_ms;
+    long ctx_switches;
+} result_t;
+
+// xorshift32, so traces are identical on every libc
+static unsigned next_random(unsigned *state) {
+    unsigned x = *state;
+    x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+    return *state = x;
+}
+
+static void generate_workload(const workload_t *w, const char *path) {
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        perror("Error creating workload");
+        exit(1);
+    }
+    
+    unsigned state = w->seed * 2654435761u;
+    int id = 0;
+    for (int t = 0; t <= LAST_ARRIVAL; t += next_random(&state) % (w->max_gap + 1)) {
+        for (int i = 0; i < w->burst; i++) {
+            int party = w->min_party + next_random(&state) % (w->max_party - w->min_party + 1);
+            fprintf(out, "%d %d %d\n", ++id, t, party);
+        }
+    }
+    fprintf(out, "-1\n");
+    fclose(out);
+}
+
+// One session: cook, then waiter, then the customer feed, all in BENCH_DIR.
+// Returns 0 if it hung or left no statistics.
+static int run_session(const char *bin_dir, result_t *result) {
+    char cook[PATH_MAX];
+    snprintf(cook, sizeof(cook), "%s/cook", bin_dir);
+    char *cook_argv[] = { cook, "-f", NULL };
+    
+    struct rusage before, after;
+    struct timespec start, end;
+    getrusage(RUSAGE_CHILDREN, &before);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    session_t session;
+    if (!session_start(bin_dir, cook_argv, &session)) {
+        return 0;
+    }
+    int clean = session_finish(&session, SESSION_TIMEOUT_MS);
+    
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    getrusage(RUSAGE_CHILDREN, &after);
+    
+    if (!clean || !read_session_stats("stats.json", &result->stats)) {
+        return 0;
+    }
+    result->wall_ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+    result->ctx_switches = (after.ru_nvcsw - before.ru_nvcsw) + (after.ru_nivcsw - before.ru_nivcsw);
+    return 1;
+}
+
+static void write_row(FILE *out, const char *workload, const char *run, const result_t *r) {
+    fprintf(out, "%s,%s,%.2f,%.4f,%.1f,%ld,%d\n", workload, run, r->stats.served_per_hour,
+            r->stats.turnaway_rate, r->wall_ms, r->ctx_switches, r->stats.p99_food);
+}
+
+int main(int argc, char *argv[]) {
+    int runs = 3;
+    const char *out_path = "bench.csv";
+    
+    int opt;
+    while ((opt = getopt(argc, argv, "n:o:")) != -1) {
+        switch (opt) {
+        case 'n': runs = atoi(optarg); break;
+        case 'o': out_path = optarg; break;
+        default: runs = 0;
+        }
+    }
+    if (runs <= 0) {
+        fprintf(stderr, "Usage: %s [-n runs] [-o bench.csv]\n", argv[0]);
+        exit(1);
+    }
+    
+    if (getenv(INSTANCE_ENV) == NULL) {
+        char instance[32];
+        snprintf(instance, sizeof(instance), "bench-%d", (int)getpid());
+        set_instance(instance);
+    }
+    
+    // The roles are started from BENCH_DIR, so resolve them up front
+    char bin_dir[PATH_MAX];
+    if (getcwd(bin_dir, sizeof(bin_dir)) == NULL) {
+        perror("getcwd");
+        exit(1);
+    }
+    
+    FILE *out = fopen(out_path, "w");
+    if (out == NULL) {
+        perror("Error opening benchmark output");
+        exit(1);
+    }
+    fprintf(out, "workload,run,served_per_hour,turnaway_rate,wall_ms,ctx_switches,p99_time_to_food\n");
+    
+    if (mkdir(BENCH_DIR, 0755) == -1 && errno != EEXIST) {
+        perror("mkdir");
+        exit(1);
+    }
+    if (chdir(BENCH_DIR) == -1) {
+        perror("chdir");
+        exit(1);
+    }
+    
+    int failed = 0;
+    printf("%-10s %12s %10s %10s %10s %10s\n",
+           "workload", "served/hour", "turnaway", "wall ms", "ctx sw", "p99 food");
+    for (int w = 0; w < NUM_WORKLOADS; w++) {
+        generate_workload(&workloads[w], "customers.txt");
+    
+        result_t mean = { 0 };
+        int completed = 0;
+        for (int i = 0; i < runs; i++) {
+            result_t r;
+            char run[16];
+            if (!run_session(bin_dir, &r)) {
+                fprintf(stderr, "%s run %d hung or produced no statistics\n", workloads[w].name, i + 1);
+                failed++;
+                continue;
+            }
+            snprintf(run, sizeof(run), "%d", i + 1);
+            write_row(out, workloads[w].name, run, &r);
+    
+            mean.stats.served_per_hour += r.stats.served_per_hour;
+            mean.stats.turnaway_rate += r.stats.turnaway_rate;
+            mean.wall_ms += r.wall_ms;
+            mean.ctx_switches += r.ctx_switches;
+            mean.stats.p99_food += r.stats.p99_food;
+            completed++;
+        }
+        if (completed == 0) continue;
+    
+        mean.stats.served_per_hour /= completed;
+        mean.stats.turnaway_rate /= completed;
+        mean.wall_ms /= completed;
+        mean.ctx_switches /= completed;
+        mean.stats.p99_food /= completed;
+        write_row(out, workloads[w].name, "mean", &mean);
+        printf("%-10s %12.2f %10.4f %10.1f %10ld %10d\n", workloads[w].name, mean.stats.served_per_hour,
+               mean.stats.turnaway_rate, mean.wall_ms, mean.ctx_switches, mean.stats.p99_food);
+    }
+    
+    fclose(out);
+    printf("Results written to %s\n", out_path);
+    if (failed) {
+        fprintf(stderr, "%d of %d runs failed\n", failed, NUM_WORKLOADS * runs);
+    }
+    return failed ? 1 : 0;
+}
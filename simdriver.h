@@ -0,0 +1,148 @@
+#ifndef SIMDRIVER_H
+#define SIMDRIVER_H
+
+#include "ipc_shared.h"
+#include <string.h>
+#include <limits.h>
+#include <signal.h>
+
+// Helpers shared by the drivers that run whole sessions (simbench, simsweep):
+// start cook, waiter and the customer feed under the current instance, wait
+// for them, and read back the stats.json the customers write.
+
+// The roles of one running session
+typedef struct {
+    pid_t cook;
+    pid_t waiter;
+    pid_t customer;
+} session_t;
+
+// Headline figures from a session's stats.json
+typedef struct {
+    double served_per_hour;
+    double turnaway_rate;
+    int p99_food;
+} session_stats_t;
+
+static inline pid_t launch(char *const argv[]) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        // Each role leads its own process group, so reap() can kill the
+        // processes it forked along with it
+        setpgid(0, 0);
+        
+        // Session output, including the roles' "Identifier removed" exits at
+        // teardown, is noise here; statistics come from stats.json
+        if (freopen("/dev/null", "w", stdout) == NULL) exit(1);
+        if (freopen("/dev/null", "w", stderr) == NULL) exit(1);
+        execv(argv[0], argv);
+        exit(1);
+    }
+    setpgid(pid, pid);   // As well, so the group exists whichever runs first
+    return pid;
+}
+
+// Wait up to ms for a role to exit, killing it and its children after that.
+// Returns 0 if it had to be killed.
+static inline int reap(pid_t pid, long ms) {
+    for (long waited = 0; waited < ms; waited += 10) {
+        if (waitpid(pid, NULL, WNOHANG) != 0) return 1;
+        usleep(10000);
+    }
+    kill(-pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    return 0;
+}
+
+// Wait until every cook and waiter has joined the virtual clock, so the
+// clock cannot run past the first arrivals before the staff is in. The
+// segment is attached directly rather than with attach_shared_memory(), which
+// would keep each session's telemetry segment mapped.
+static inline int wait_staffed(void) {
+    int shmid = shmget(get_key(), 0, 0);
+    if (shmid == -1) return 0;
+    shared_t *shm = (shared_t *)shmat(shmid, NULL, SHM_RDONLY);
+    if (shm == (void *) -1) return 0;
+    
+    int ready = 0;
+    if (shm->header.magic == SHM_MAGIC && shm->header.version == SHM_VERSION) {
+        for (int i = 0; i < 5000 && !ready; i++) {
+            ready = atomic_load(&shm->staffed.cooks) == shm->config.cooks &&
+                    atomic_load(&shm->staffed.waiters) == shm->config.waiters;
+            if (!ready) usleep(1000);
+        }
+    }
+    shmdt(shm);
+    return ready;
+}
+
+// Start a session from the current directory: cook_argv (its argv[0] is the
+// cook binary), then the waiters and, once the whole staff has joined, the
+// customers writing stats.json. Returns 0, with the roles reaped, if the
+// staff never comes up.
+static inline int session_start(const char *bin_dir, char *const cook_argv[], session_t *session) {
+    char waiter[PATH_MAX], customer[PATH_MAX];
+    snprintf(waiter, sizeof(waiter), "%s/waiter", bin_dir);
+    snprintf(customer, sizeof(customer), "%s/customer", bin_dir);
+    char *waiter_argv[] = { waiter, NULL };
+    char *customer_argv[] = { customer, "-o", "stats.json", NULL };
+    
+    unlink("stats.json");
+    session->cook = launch(cook_argv);
+    
+    // The semaphore set is created after the segment is published
+    for (int i = 0; i < 500 && semset_get(0, 0666) == -1; i++) {
+        usleep(10000);
+    }
+    session->waiter = launch(waiter_argv);
+    if (!wait_staffed()) {
+        reap(session->cook, 5000);
+        reap(session->waiter, 5000);
+        return 0;
+    }
+    session->customer = launch(customer_argv);
+    return 1;
+}
+
+// Give the customers up to timeout_ms to finish, then the staff a few
+// seconds. Returns 0 if any role hung and had to be killed: its stats.json
+// may exist, but the session did not end cleanly.
+static inline int session_finish(const session_t *session, long timeout_ms) {
+    int clean = reap(session->customer, timeout_ms);
+    clean &= reap(session->cook, 5000);
+    clean &= reap(session->waiter, 5000);
+    return clean;
+}
+
+// Pull a number that follows "key": in the flat stats.json layout
+static inline double json_number(const char *json, const char *key) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\": ", key);
+    const char *p = strstr(json, pattern);
+    return p ? atof(p + strlen(pattern)) : 0.0;
+}
+
+static inline int read_session_stats(const char *path, session_stats_t *stats) {
+    static char json[16384];
+    FILE *in = fopen(path, "r");
+    if (in == NULL) return 0;
+    size_t n = fread(json, 1, sizeof(json) - 1, in);
+    json[n] = '\0';
+    fclose(in);
+    
+    double minutes = json_number(json, "session_minutes");
+    double arrived = json_number(json, "arrived");
+    stats->served_per_hour = minutes > 0 ? json_number(json, "served") * 60.0 / minutes : 0.0;
+    stats->turnaway_rate = arrived > 0 ? json_number(json, "turned_away") / arrived : 0.0;
+    
+    const char *food = strstr(json, "\"seated_to_served\"");
+    stats->p99_food = food ? (int)json_number(food, "p99") : 0;
+    return 1;
+}
+
+#endif // SIMDRIVER_H
@@ -0,0 +1,339 @@
+#include "simdriver.h"
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+
+// Parameter sweep: runs one virtual-clock session for every combination of
+// the given staffing and policy lists, several at a time, and collects their
+// stats.json reports into one table. Each session runs in its own directory
+// under SWEEP_DIR with its own instance name, so their IPC keys never meet.
+//
+//   simsweep -t 4,8 -w 2,3 -c 1,2 -a rr,p2c -j 8
+//   simsweep -q 2 -x "" -x "-S cook:2,plate:1 -B 4,2"
+//
+// Results go to a CSV with one row per configuration, in grid order. An
+// option set with -S staffs the kitchen itself: it is not crossed with the
+// -c list, and its cooks column is the stations' total.
+
+#define SWEEP_DIR "sweep.d"
+#define MAX_VALUES 16             // Per parameter list
+#define MAX_OPTION_WORDS 16       // Words in one -x option set
+
+typedef struct {
+    int count;
+    int values[MAX_VALUES];
+} int_list_t;
+
+typedef struct {
+    int count;
+    const char *values[MAX_VALUES];
+} name_list_t;
+
+typedef struct {
+    int tables, waiters, queue_size;
+    int cooks;                    // -c, or the station cooks when options give -S
+    const char *assign, *kitchen;
+    const char *options;          // Extra cook options, "" for none
+    pid_t pid;
+    struct timespec start;
+    double wall_ms;
+    int hung;                     // A role had to be killed
+    session_stats_t stats;
+} job_t;
+
+static const char *prog;
+
+static void usage(void) {
+    fprintf(stderr, "Usage: %s [-t tables,...] [-w waiters,...] [-c cooks,...] [-q queue_size,...]\n"
+            "          [-a rr|least|p2c,...] [-k fifo|sjf|deadline,...] [-j jobs] [-T trace]\n"
+            "          [-x cook_options]... [-s timeout] [-o sweep.csv]\n"
+            "  -x  extra cook options, such as \"-S cook:2,plate:1\"; each -x is one value;\n"
+            "      with -S, the stations' cooks replace the -c list\n"
+            "  -j  sessions run at once (default: one per online CPU)\n"
+            "  -T  customer trace every session replays (default customers.txt)\n"
+            "  -s  seconds before a session is killed (default 60)\n", prog);
+    exit(1);
+}
+
+static void parse_ints(const char *arg, int_list_t *list) {
+    list->count = 0;
+    for (const char *p = arg; *p; ) {
+        char *next;
+        long v = strtol(p, &next, 10);
+        if (next == p || v <= 0 || list->count == MAX_VALUES) usage();
+        list->values[list->count++] = v;
+        p = (*next == ',') ? next + 1 : next;
+    }
+    if (list->count == 0) usage();
+}
+
+// Splits arg in place; the names are checked by cook itself
+static void parse_names(char *arg, name_list_t *list) {
+    list->count = 0;
+    for (char *name = strtok(arg, ","); name != NULL; name = strtok(NULL, ",")) {
+        if (list->count == MAX_VALUES) usage();
+        list->values[list->count++] = name;
+    }
+    if (list->count == 0) usage();
+}
+
+// Cooks staffing the station chain an option set's -S gives, 0 without -S.
+// The chain replaces -c, so the sweep reports and varies these instead.
+static int station_cooks(const char *options) {
+    char words[256];
+    snprintf(words, sizeof(words), "%s", options);
+    char *save, *spec = NULL;
+    for (char *word = strtok_r(words, " ", &save); word != NULL; word = strtok_r(NULL, " ", &save)) {
+        if (strncmp(word, "-S", 2) == 0) {
+            spec = word[2] ? word + 2 : strtok_r(NULL, " ", &save);
+        }
+    }
+    if (spec == NULL) return 0;
+    
+    int total = 0;
+    for (char *tok = strtok_r(spec, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+        char *colon = strchr(tok, ':');
+        total += colon ? atoi(colon + 1) : 1;
+    }
+    return total;
+}
+
+// Remove whatever the session left behind under this instance's keys
+static void remove_instance_ipc(void) {
+    int id = shmget(get_key(), 0, 0);
+    if (id != -1) shmctl(id, IPC_RMID, NULL);
+    int sems = semset_get(0, 0666);
+    if (sems != -1) semset_remove(sems);
+    telemetry_remove();
+}
+
+// One session, run in the forked worker from the job's directory. Returns
+// 0 if it did not start or did not end by itself.
+static int run_job(const job_t *job, const char *bin_dir, int timeout) {
+    char cook[PATH_MAX];
+    snprintf(cook, sizeof(cook), "%s/cook", bin_dir);
+    
+    char tables[16], waiters[16], cooks[16], queue_size[16];
+    snprintf(tables, sizeof(tables), "%d", job->tables);
+    snprintf(waiters, sizeof(waiters), "%d", job->waiters);
+    snprintf(cooks, sizeof(cooks), "%d", job->cooks);
+    snprintf(queue_size, sizeof(queue_size), "%d", job->queue_size);
+    char *cook_argv[15 + MAX_OPTION_WORDS] = { cook, "-f", "-t", tables, "-w", waiters,
+                                               "-q", queue_size, "-a", (char *)job->assign,
+                                               "-k", (char *)job->kitchen };
+    int argc = 12;
+    if (!station_cooks(job->options)) {
+        cook_argv[argc++] = "-c";
+        cook_argv[argc++] = cooks;
+    }
+    
+    // The extra options follow, split on spaces
+    char options[256];
+    snprintf(options, sizeof(options), "%s", job->options);
+    int base = argc;
+    for (char *word = strtok(options, " "); word != NULL && argc < base + MAX_OPTION_WORDS;
+         word = strtok(NULL, " ")) {
+        cook_argv[argc++] = word;
+    }
+    cook_argv[argc] = NULL;
+    
+    session_t session;
+    int clean = session_start(bin_dir, cook_argv, &session) &&
+                session_finish(&session, timeout * 1000L);
+    remove_instance_ipc();
+    return clean;
+}
+
+static void start_job(job_t *job, int index, const char *bin_dir, const char *trace, int timeout) {
+    char dir[64];
+    snprintf(dir, sizeof(dir), SWEEP_DIR "/%d", index);
+    if (mkdir(dir, 0755) == -1 && errno != EEXIST) {
+        perror("mkdir");
+        exit(1);
+    }
+    
+    fflush(stdout);
+    clock_gettime(CLOCK_MONOTONIC, &job->start);
+    job->pid = fork();
+    if (job->pid == -1) {
+        perror("fork");
+        exit(1);
+    }
+    if (job->pid == 0) {
+        char instance[64];
+        snprintf(instance, sizeof(instance), "sweep-%d-%d", (int)getppid(), index);
+        set_instance(instance);
+        if (chdir(dir) == -1) {
+            perror("chdir");
+            exit(1);
+        }
+        unlink("customers.txt");
+        if (symlink(trace, "customers.txt") == -1) {
+            perror("symlink");
+            exit(1);
+        }
+        exit(run_job(job, bin_dir, timeout) ? 0 : 1);
+    }
+}
+
+// Wait for any worker and stamp its job's wall time and outcome
+static void finish_job(job_t *jobs, int count) {
+    int status;
+    pid_t pid = wait(&status);
+    if (pid == -1) {
+        perror("wait");
+        exit(1);
+    }
+    
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    for (int i = 0; i < count; i++) {
+        if (jobs[i].pid == pid) {
+            jobs[i].wall_ms = (end.tv_sec - jobs[i].start.tv_sec) * 1e3 +
+                              (end.tv_nsec - jobs[i].start.tv_nsec) / 1e6;
+            jobs[i].hung = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+            jobs[i].pid = 0;
+            return;
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int_list_t tables = { 1, { DEFAULT_TABLES } }, waiters = { 1, { DEFAULT_WAITERS } };
+    int_list_t cooks = { 1, { DEFAULT_COOKS } }, queue_sizes = { 1, { DEFAULT_QUEUE_SIZE } };
+    name_list_t assign = { 1, { "rr" } }, kitchen = { 1, { "fifo" } };
+    name_list_t options = { 1, { "" } };
+    int options_given = 0;
+    long parallel = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *trace_path = "customers.txt";
+    const char *out_path = "sweep.csv";
+    int timeout = 60;
+    prog = argv[0];
+    
+    int opt;
+    while ((opt = getopt(argc, argv, "t:w:c:q:a:k:x:j:T:s:o:")) != -1) {
+        switch (opt) {
+        case 't': parse_ints(optarg, &tables); break;
+        case 'w': parse_ints(optarg, &waiters); break;
+        case 'c': parse_ints(optarg, &cooks); break;
+        case 'q': parse_ints(optarg, &queue_sizes); break;
+        case 'a': parse_names(optarg, &assign); break;
+        case 'k': parse_names(optarg, &kitchen); break;
+        case 'x':
+            // Option sets hold commas themselves, so each -x adds one
+            if (!options_given++) options.count = 0;
+            if (options.count == MAX_VALUES) usage();
+            options.values[options.count++] = optarg;
+            break;
+        case 'j': parallel = atol(optarg); break;
+        case 'T': trace_path = optarg; break;
+        case 's': timeout = atoi(optarg); break;
+        case 'o': out_path = optarg; break;
+        default: usage();
+        }
+    }
+    if (parallel <= 0 || timeout <= 0) usage();
+    
+    // Workers run from their own directories, so resolve paths up front. The
+    // roles are the ones built alongside simsweep.
+    char bin_dir[PATH_MAX], trace[PATH_MAX];
+    ssize_t len = readlink("/proc/self/exe", bin_dir, sizeof(bin_dir) - 1);
+    if (len == -1) {
+        perror("readlink");
+        exit(1);
+    }
+    bin_dir[len] = '\0';
+    *strrchr(bin_dir, '/') = '\0';
+    if (realpath(trace_path, trace) == NULL) {
+        perror(trace_path);
+        exit(1);
+    }
+    
+    // Expand the grid, last list varying fastest. An option set with -S
+    // brings its own cooks, so it runs once per point rather than once per -c.
+    int grid = tables.count * waiters.count * cooks.count * queue_sizes.count *
+               assign.count * kitchen.count * options.count;
+    job_t *jobs = calloc(grid, sizeof(job_t));
+    if (jobs == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    int count = 0;
+    for (int i = 0; i < grid; i++) {
+        job_t *job = &jobs[count];
+        int rest = i;
+        job->options = options.values[rest % options.count]; rest /= options.count;
+        job->kitchen = kitchen.values[rest % kitchen.count]; rest /= kitchen.count;
+        job->assign = assign.values[rest % assign.count]; rest /= assign.count;
+        job->queue_size = queue_sizes.values[rest % queue_sizes.count]; rest /= queue_sizes.count;
+        int cook_index = rest % cooks.count; rest /= cooks.count;
+        job->waiters = waiters.values[rest % waiters.count]; rest /= waiters.count;
+        job->tables = tables.values[rest];
+        
+        job->cooks = station_cooks(job->options);
+        if (job->cooks == 0) {
+            job->cooks = cooks.values[cook_index];
+        } else if (cook_index > 0) {
+            continue;
+        }
+        count++;
+    }
+    
+    if (mkdir(SWEEP_DIR, 0755) == -1 && errno != EEXIST) {
+        perror("mkdir");
+        exit(1);
+    }
+    
+    printf("Sweeping %d configurations, %ld at a time\n", count, parallel);
+    int running = 0;
+    for (int i = 0; i < count; i++) {
+        if (running == parallel) {
+            finish_job(jobs, count);
+            running--;
+        }
+        start_job(&jobs[i], i, bin_dir, trace, timeout);
+        running++;
+    }
+    for (; running > 0; running--) {
+        finish_job(jobs, count);
+    }
+    
+    FILE *out = fopen(out_path, "w");
+    if (out == NULL) {
+        perror("Error opening sweep output");
+        exit(1);
+    }
+    fprintf(out, "tables,waiters,cooks,queue_size,assign,kitchen,options,"
+            "served_per_hour,turnaway_rate,p99_time_to_food,wall_ms\n");
+    printf("%6s %7s %5s %5s %6s %8s %12s %10s %10s %10s  %s\n", "tables", "waiters", "cooks",
+           "queue", "assign", "kitchen", "served/hour", "turnaway", "p99 food", "wall ms", "options");
+    
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        job_t *job = &jobs[i];
+        char path[64];
+        snprintf(path, sizeof(path), SWEEP_DIR "/%d/stats.json", i);
+        if (job->hung) {
+            fprintf(stderr, "Configuration %d hung and was killed\n", i);
+            failed++;
+            continue;
+        }
+        if (!read_session_stats(path, &job->stats)) {
+            fprintf(stderr, "Configuration %d produced no statistics\n", i);
+            failed++;
+            continue;
+        }
+        fprintf(out, "%d,%d,%d,%d,%s,%s,\"%s\",%.2f,%.4f,%d,%.1f\n", job->tables, job->waiters,
+                job->cooks, job->queue_size, job->assign, job->kitchen, job->options,
+                job->stats.served_per_hour, job->stats.turnaway_rate, job->stats.p99_food,
+                job->wall_ms);
+        printf("%6d %7d %5d %5d %6s %8s %12.2f %10.4f %10d %10.1f  %s\n", job->tables,
+               job->waiters, job->cooks, job->queue_size, job->assign, job->kitchen,
+               job->stats.served_per_hour, job->stats.turnaway_rate, job->stats.p99_food,
+               job->wall_ms, job->options);
+    }
+    
+    fclose(out);
+    printf("Results written to %s\n", out_path);
+    return failed ? 1 : 0;
+}
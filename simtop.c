@@ -0,0 +1,163 @@
+#include "telemetry.h"
+#include <string.h>
+#include <time.h>
+
+// Live monitor: attaches the session's telemetry segment read-only and
+// redraws a top-like view of tables, queues, roles and lock contention.
+// Every read is a seqlock snapshot or an atomic load; simtop never takes a
+// semaphore, so it cannot block or reorder the roles it watches.
+//
+// Start it after cook; it exits once the session's segments are removed.
+
+typedef struct {
+    seating_telemetry_t seating;
+    role_telemetry_t *roles;
+    int *pending;                 // Per waiter
+    int kitchen_pending;
+    long acquired[FIXED_SEMS];    // Per lock domain
+    long contended[FIXED_SEMS];
+    long wait_ns[FIXED_SEMS];
+    struct timespec at;
+} snapshot_t;
+
+static const char *lock_names[FIXED_SEMS] = { "tables", NULL, "kitchen", "clock" };
+
+static void take_snapshot(const telemetry_t *t, snapshot_t *snap) {
+    int roles = t->cooks + t->waiters;
+    
+    clock_gettime(CLOCK_MONOTONIC, &snap->at);
+    if (!seq_read(&t->seating, &snap->seating, sizeof(snap->seating))) {
+        snap->seating.seq = 1;   // Marks the copy as stale
+    }
+    for (int i = 0; i < roles; i++) {
+        if (!seq_read(&t->roles[i], &snap->roles[i], sizeof(role_telemetry_t))) {
+            snap->roles[i].seq = 1;
+        }
+    }
+    for (int w = 0; w < t->waiters; w++) {
+        snap->pending[w] = atomic_load(&WAITER_TELEMETRY(t, w)->pending);
+    }
+    snap->kitchen_pending = atomic_load(&t->pending_orders);
+    for (int i = 0; i < FIXED_SEMS; i++) {
+        snap->acquired[i] = atomic_load(&t->locks[i].acquired);
+        snap->contended[i] = atomic_load(&t->locks[i].contended);
+        snap->wait_ns[i] = atomic_load(&t->locks[i].wait_ns);
+    }
+}
+
+static double seconds_between(const struct timespec *a, const struct timespec *b) {
+    return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+static long total_orders(const telemetry_t *t, const snapshot_t *snap, int first, int count) {
+    long total = 0;
+    for (int i = first; i < first + count; i++) {
+        total += snap->roles[i].orders;
+    }
+    return total;
+}
+
+static void draw(const telemetry_t *t, const snapshot_t *prev, const snapshot_t *now, int batch) {
+    double dt = seconds_between(&prev->at, &now->at);
+    if (dt <= 0) dt = 1;
+    
+    const seating_telemetry_t *st = &now->seating;
+    long taken = total_orders(t, now, t->cooks, t->waiters);
+    long cooked = total_orders(t, now, 0, t->cooks);
+    double taken_rate = (taken - total_orders(t, prev, t->cooks, t->waiters)) / dt;
+    double cooked_rate = (cooked - total_orders(t, prev, 0, t->cooks)) / dt;
+    
+    if (!batch) printf("\033[H\033[J");
+    printf("simtop - minute %d (%d:%02d)%s\n", st->time, 11 + st->time / 60, st->time % 60,
+           (st->seq & 1) ? "  [stale]" : "");
+    printf("Tables:  %d/%d empty, %ld seated, %ld turned away, %ld left\n",
+           st->empty_tables, t->tables, st->seated, st->turned_away, st->left);
+    printf("Orders:  %d pending in kitchen, %ld taken (%.1f/s), %ld cooked (%.1f/s)\n\n",
+           now->kitchen_pending, taken, taken_rate, cooked, cooked_rate);
+    
+    printf("%-6s %-7s %8s %8s %8s %8s %8s\n",
+           "ROLE", "NAME", "ORDER", "PENDING", "ORDERS", "SERVED", "BUSY");
+    for (int i = 0; i < t->cooks + t->waiters; i++) {
+        const role_telemetry_t *rt = &now->roles[i];
+        int is_cook = i < t->cooks;
+        char order[16] = "-", pending[16] = "-", served[16] = "-";
+        if (rt->customer >= 0) snprintf(order, sizeof(order), "#%d", rt->customer);
+        if (!is_cook) {
+            snprintf(pending, sizeof(pending), "%d", now->pending[i - t->cooks]);
+            snprintf(served, sizeof(served), "%ld", rt->served);
+        }
+        printf("%-6s %-7s %8s %8s %8ld %8s %8ld%s\n", is_cook ? "cook" : "waiter",
+               is_cook ? cook_name(i) : waiter_name(i - t->cooks), order, pending,
+               rt->orders, served, rt->busy_minutes, (rt->seq & 1) ? "  [stale]" : "");
+    }
+    
+    printf("\n%-8s %12s %10s %10s %10s\n", "LOCK", "ACQUIRED", "CONTENDED", "WAIT ms", "WAIT/s ms");
+    for (int i = 0; i < FIXED_SEMS; i++) {
+        if (lock_names[i] == NULL) continue;
+        printf("%-8s %12ld %10ld %10.1f %10.2f\n", lock_names[i], now->acquired[i],
+               now->contended[i], now->wait_ns[i] / 1e6,
+               (now->wait_ns[i] - prev->wait_ns[i]) / 1e6 / dt);
+    }
+    fflush(stdout);
+}
+
+// The session is over once its telemetry segment has been marked for removal
+static int session_ended(int id) {
+    struct shmid_ds ds;
+    return shmctl(id, IPC_STAT, &ds) == -1 || (ds.shm_perm.mode & SHM_DEST);
+}
+
+int main(int argc, char *argv[]) {
+    int interval_ms = 500;
+    int iterations = -1;
+    int batch = 0;
+    
+    int opt;
+    while ((opt = getopt(argc, argv, "i:n:bN:")) != -1) {
+        switch (opt) {
+        case 'i': interval_ms = atoi(optarg); break;   // Refresh period
+        case 'n': iterations = atoi(optarg); break;    // Stop after this many refreshes
+        case 'b': batch = 1; break;                    // Append frames instead of redrawing
+        case 'N': set_instance(optarg); break;         // Session to watch
+        default:
+            fprintf(stderr, "Usage: %s [-i interval_ms] [-n refreshes] [-b] [-N instance]\n", argv[0]);
+            exit(1);
+        }
+    }
+    if (interval_ms <= 0) interval_ms = 500;
+    
+    int id = shmget(get_telemetry_key(), 0, 0);
+    telemetry_t *t = telemetry_attach(SHM_RDONLY);
+    if (id == -1 || t == NULL) {
+        fprintf(stderr, "simtop: no session telemetry (start cook first)\n");
+        exit(1);
+    }
+    
+    int roles = t->cooks + t->waiters;
+    snapshot_t snaps[2];
+    for (int i = 0; i < 2; i++) {
+        snaps[i].roles = calloc(roles, sizeof(role_telemetry_t));
+        snaps[i].pending = calloc(t->waiters, sizeof(int));
+        if (snaps[i].roles == NULL || snaps[i].pending == NULL) {
+            perror("calloc");
+            exit(1);
+        }
+    }
+    
+    take_snapshot(t, &snaps[0]);
+    for (int n = 0; iterations < 0 || n < iterations; n++) {
+        usleep(interval_ms * 1000);
+        snapshot_t *prev = &snaps[n % 2], *now = &snaps[(n + 1) % 2];
+        take_snapshot(t, now);
+        draw(t, prev, now, batch);
+        if (batch) printf("\n");
+    
+        if (session_ended(id)) {
+            printf("Session ended.\n");
+            break;
+        }
+    }
+    
+    shmdt(t);
+    return 0;
+}
@@ -0,0 +1,195 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "ipc_base.h"
+
+// Live telemetry (see simtop.c). A second, small segment the roles publish
+// gauges and counters into while they run. `simtop` attaches it read-only
+// and never takes a semaphore, so watching a session does not perturb it.
+//
+// Single values updated by many writers are atomics. Groups of fields that
+// only make sense together have one writer at a time and a seqlock: the
+// writer makes seq odd, updates the group and makes seq even again; a
+// reader copies the group and retries if seq was odd or moved meanwhile.
+#define TELEMETRY_MAGIC 0x4d4c5453   // "STLM"
+#define TELEMETRY_VERSION 1
+
+// Seating state, written under TABLES_SEM
+typedef struct {
+    _Atomic unsigned seq;
+    int time;              // Clock at the last seating change
+    int empty_tables;
+    long seated;
+    long turned_away;      // No table, or the waiter's queue was full
+    long left;
+} seating_telemetry_t;
+
+// One per cook and per waiter; the seqlocked fields are written only by
+// that role, pending by the customers and the waiter
+typedef struct {
+    _Atomic unsigned seq CACHE_ALIGNED;
+    int time;              // Clock at the last update
+    int customer;          // Order in hand, -1 when idle
+    long orders;           // Orders cooked (cook) or taken (waiter)
+    long served;           // Meals carried to tables (waiter)
+    long busy_minutes;
+    _Atomic int pending;   // Mirrors WAITER_PENDING_ORDERS (waiter)
+} role_telemetry_t;
+
+// One per lock domain
+typedef struct {
+    _Atomic long acquired CACHE_ALIGNED;
+    _Atomic long contended;   // Acquisitions that found the lock held
+    _Atomic long wait_ns;     // Wall time spent blocked on it
+} lock_telemetry_t;
+
+typedef struct {
+    struct {
+        unsigned magic;
+        unsigned version;
+        unsigned size;
+    } header CACHE_ALIGNED;
+    
+    int tables;
+    int waiters;
+    int cooks;
+    
+    _Atomic int pending_orders CACHE_ALIGNED;   // Mirrors PENDING_ORDERS
+    lock_telemetry_t locks[FIXED_SEMS];         // Indexed by semaphore; COOK_SEM unused
+    seating_telemetry_t seating CACHE_ALIGNED;
+    role_telemetry_t roles[];                   // Cooks, then waiters
+} telemetry_t;
+
+#define TELEMETRY_SIZE(c) (sizeof(telemetry_t) + ((c)->cooks + (c)->waiters) * sizeof(role_telemetry_t))
+#define COOK_TELEMETRY(t, c) (&(t)->roles[(c)])
+#define WAITER_TELEMETRY(t, w) (&(t)->roles[(t)->cooks + (w)])
+
+// This process's writable mapping, or NULL when no session publishes telemetry
+static telemetry_t *telemetry = NULL;
+
+static inline key_t get_telemetry_key() {
+    return instance_key(PROJ_ID + 2);
+}
+
+// Attach the session's telemetry segment with shmat() flags. Returns NULL
+// if there is none or it was laid out by a different build.
+static inline telemetry_t *telemetry_attach(int flags) {
+    int id = shmget(get_telemetry_key(), 0, 0);
+    if (id == -1) {
+        return NULL;
+    }
+    telemetry_t *t = (telemetry_t *)shmat(id, NULL, flags);
+    if (t == (void *) -1) {
+        return NULL;
+    }
+    if (t->header.magic != TELEMETRY_MAGIC || t->header.version != TELEMETRY_VERSION) {
+        shmdt(t);
+        return NULL;
+    }
+    return t;
+}
+
+// Remove the session's telemetry segment; simtop notices and exits
+static inline void telemetry_remove() {
+    int id = shmget(get_telemetry_key(), 0, 0);
+    if (id != -1 && shmctl(id, IPC_RMID, NULL) == -1) {
+        perror("shmctl: telemetry");
+    }
+}
+
+static inline void seq_write_begin(_Atomic unsigned *seq) {
+    atomic_store_explicit(seq, atomic_load_explicit(seq, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static inline void seq_write_end(_Atomic unsigned *seq) {
+    atomic_store_explicit(seq, atomic_load_explicit(seq, memory_order_relaxed) + 1,
+                          memory_order_release);
+}
+
+// Copy a seqlocked group of len bytes starting at its seq field. Returns 0
+// if no consistent copy could be made, e.g. because its writer died mid-update.
+static inline int seq_read(const void *group, void *copy, size_t len) {
+    const _Atomic unsigned *seq = group;
+    for (int tries = 0; tries < 1000; tries++) {
+        unsigned before = atomic_load_explicit(seq, memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+        memcpy(copy, group, len);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(seq, memory_order_relaxed) == before) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Take a lock domain semaphore, timing the wait when it is contended
+static inline void take_lock(int semid, int sem_num) {
+    if (telemetry == NULL) {
+        take(semid, sem_num);
+        return;
+    }
+    lock_telemetry_t *lt = &telemetry->locks[sem_num];
+    atomic_fetch_add_explicit(&lt->acquired, 1, memory_order_relaxed);
+    if (try_take(semid, sem_num)) {
+        return;
+    }
+    
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    take(semid, sem_num);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    atomic_fetch_add_explicit(&lt->contended, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&lt->wait_ns, (end.tv_sec - start.tv_sec) * 1000000000L +
+                              (end.tv_nsec - start.tv_nsec), memory_order_relaxed);
+}
+
+// Publish the seating state after a change. Must be called with TABLES_SEM held.
+static inline void telemetry_seating(int time, int empty_tables, int seated, int turned_away, int left) {
+    if (telemetry == NULL) return;
+    seating_telemetry_t *st = &telemetry->seating;
+    seq_write_begin(&st->seq);
+    st->time = time;
+    st->empty_tables = empty_tables;
+    st->seated += seated;
+    st->turned_away += turned_away;
+    st->left += left;
+    seq_write_end(&st->seq);
+}
+
+// Publish a role's progress: the order now in hand and counter increments
+static inline void telemetry_role(role_telemetry_t *rt, int time, int customer, int orders,
+                           int served, int busy_minutes) {
+    seq_write_begin(&rt->seq);
+    rt->time = time;
+    rt->customer = customer;
+    rt->orders += orders;
+    rt->served += served;
+    rt->busy_minutes += busy_minutes;
+    seq_write_end(&rt->seq);
+}
+
+static inline void telemetry_cook(int cook_id, int time, int customer, int orders, int busy_minutes) {
+    if (telemetry == NULL) return;
+    telemetry_role(COOK_TELEMETRY(telemetry, cook_id), time, customer, orders, 0, busy_minutes);
+}
+
+static inline void telemetry_waiter(int waiter_id, int time, int customer, int orders, int served,
+                             int busy_minutes) {
+    if (telemetry == NULL) return;
+    telemetry_role(WAITER_TELEMETRY(telemetry, waiter_id), time, customer, orders, served,
+                   busy_minutes);
+}
+
+// Track a queue gauge: a waiter's backlog, or the kitchen's for waiter_id -1
+static inline void telemetry_pending(int waiter_id, int delta) {
+    if (telemetry == NULL) return;
+    _Atomic int *gauge = waiter_id < 0 ? &telemetry->pending_orders
+                                       : &WAITER_TELEMETRY(telemetry, waiter_id)->pending;
+    atomic_fetch_add_explicit(gauge, delta, memory_order_relaxed);
+}
+
+#endif // TELEMETRY_H
@@ -0,0 +1,22 @@
+#ifndef TRACE_FORMAT_H
+#define TRACE_FORMAT_H
+
+#include <stdint.h>
+
+// Binary customer trace written by `gencustomers -B`: a header, then one
+// fixed-size record per customer in arrival order (no -1 terminator)
+#define TRACE_MAGIC 0x52544453   // "SDTR"
+#define TRACE_VERSION 1
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+} trace_header_t;
+
+typedef struct {
+    uint32_t id;
+    uint32_t arrival;    // Minutes after 11:00am
+    uint32_t party;
+} trace_record_t;
+
+#endif // TRACE_FORMAT_H
@@ -1,4 +1,5 @@
 #include "ipc_shared.h"
+#include "decisions.h"
 #include <signal.h>
 #include <time.h>
 
@@ -10,83 +11,131 @@ int semid = -1;
 void cleanup_handler(int sig) {
     printf("Waiter process received signal %d, cleaning up...\n", sig);
     if (shmid != -1) shmctl(shmid, IPC_RMID, NULL);
-    if (semid != -1) semctl(semid, 0, IPC_RMID);
+    if (semid != -1) semset_remove(semid);
+    telemetry_remove();
     exit(1);
 }
 
+// Take one order: record how long it waited, spend a minute with the
+// customer, then hand it to the kitchen. Called inside the wakeup's
+// decision section, which it ends.
+static void take_order(shared_t *shm, int semid, int waiter_id, order_t *order, int stolen) {
+    LIFECYCLE(shm, order->seat)->order_taken = clock_now(shm);
+    telemetry_waiter(waiter_id, clock_now(shm), order->customer_id, 0, 0, 0);
+    log_event(shm, EV_WAITER_TAKING, waiter_id, order->customer_id, order->count, stolen);
+    decision_end(shm, semid, order->customer_id);
+    
+    // Simulate time to take order (1 minute)
+    update_time(shm, semid, WAITER_TIMER_SEM(shm, waiter_id), 1);
+    atomic_fetch_add(&shm->stats.waiters.busy, 1);
+    
+    // Add order to cook queue, dish by dish with stations. Every entry needs
+    // a kitchen credit; with none left the waiter blocks until a cook frees
+    // one and hands it over, so a saturated kitchen keeps it from taking
+    // more orders and the backlog reaches the customers.
+    int credit = 0, queued = 0;
+    while (!queued) {
+        decision_begin(shm, semid, DECISION_WAITER(shm, waiter_id), DECISION_WAITER_SUBMIT);
+        if (!credit && !kitchen_take_credit(shm, semid, waiter_id)) {
+            log_event(shm, EV_WAITER_KITCHEN_FULL, waiter_id, 0, 0, 0);
+            decision_end(shm, semid, 0);
+            int since = clock_now(shm);
+            wait_event(shm, semid, WAITER_TIMER_SEM(shm, waiter_id));
+            atomic_fetch_add(&shm->stats.waiters.kitchen_blocked, clock_now(shm) - since);
+            credit = 1;
+            continue;
+        }
+        credit = 0;
+        queued = add_cooking_request(shm, order);
+        
+        // Signal cook that new order is available
+        signal_event(shm, semid, COOK_SEM);
+        if (!queued) {
+            decision_end(shm, semid, 1);
+        }
+    }
+    log_event(shm, EV_WAITER_SUBMITTED, waiter_id, order->customer_id, 0, 0);
+    telemetry_waiter(waiter_id, clock_now(shm), -1, 1, 0, 1);
+    
+    // Back to waiting; customers may nudge us to steal from here on
+    atomic_store(&WAITER_AREA(shm, waiter_id)->idle, 1);
+    decision_end(shm, semid, 1);
+}
+
 // Function executed by each waiter process
 void wmain(int waiter_id, int shmid, int semid) {
-    char waiter_name = 'U' + waiter_id;
-    printf("Waiter %c started (PID: %d)\n", waiter_name, getpid());
-    
     // Attach to shared memory
-    int *shm = (int *)shmat(shmid, NULL, 0);
-    if (shm == (void *) -1) {
-        perror("shmat in waiter");
-        exit(1);
-    }
+    shared_t *shm = attach_shared_memory(shmid);
+    log_event(shm, EV_WAITER_STARTED, waiter_id, getpid(), 0, 0);
+    
+    // Orders handed to the kitchen and not yet served
+    int outstanding = 0;
+    
+    // While idle, customers queued on a busy waiter may nudge us to steal.
+    // The flag only changes inside decision sections so replay sees the
+    // same nudges.
+    atomic_store(&WAITER_AREA(shm, waiter_id)->idle, 1);
     
     while (1) {
         // Wait for signal (from cook or customer)
-        take(semid, WAITER_SEM_BASE + waiter_id);
+        wait_event(shm, semid, WAITER_SEM(shm, waiter_id));
+        decision_begin(shm, semid, DECISION_WAITER(shm, waiter_id), DECISION_WAITER_WAKE);
+        atomic_store(&WAITER_AREA(shm, waiter_id)->idle, 0);
         
         // Check if session should end
-        take(semid, MUTEX_SEM);
-        if (TIME(shm) >= 180 && shm[WAITER_PENDING_ORDERS(waiter_id)] == 0) {
-            put(semid, MUTEX_SEM);
+        int pending = atomic_load(&WAITER_PENDING_ORDERS(shm, waiter_id));
+        if (restaurant_closed(shm) && pending == 0 && outstanding == 0 &&
+            ring_empty(WAITER_MAILBOX(shm, waiter_id))) {
+            decision_end(shm, semid, -1);
             break;
         }
         
-        // Check if food is ready to be served
-        if (shm[WAITER_FOOD_READY(waiter_id)] != -1) {
-            int customer_id = shm[WAITER_FOOD_READY(waiter_id)];
-            printf("Waiter %c serving food to customer %d\n", waiter_name, customer_id);
-            
-            // Reset food ready flag
-            shm[WAITER_FOOD_READY(waiter_id)] = -1;
+        // Serve every order the cooks have finished since the last wakeup
+        order_t order;
+        while (get_food_ready(shm, waiter_id, &order)) {
+            log_event(shm, EV_WAITER_SERVING, waiter_id, order.customer_id, 0, 0);
+            outstanding--;
+            LIFECYCLE(shm, order.seat)->served = clock_now(shm);
+            telemetry_waiter(waiter_id, clock_now(shm), -1, 0, 1, 0);
             
             // Signal customer that food is ready
-            put(semid, MUTEX_SEM);
-            put(semid, CUSTOMER_SEM_BASE + customer_id);
+            signal_event(shm, semid, SEAT_SEM(shm, order.seat));
         }
-        // Check if there's a new customer order to process
-        else if (shm[WAITER_PENDING_ORDERS(waiter_id)] > 0) {
-            int front = shm[WAITER_FRONT(waiter_id)];
-            int customer_id = shm[WAITER_QUEUE_START(waiter_id) + front*2];
-            int count = shm[WAITER_QUEUE_START(waiter_id) + front*2 + 1];
-            
-            // Move front of queue
-            shm[WAITER_FRONT(waiter_id)] = (front + 1) % QUEUE_SIZE;
-            shm[WAITER_PENDING_ORDERS(waiter_id)]--;
-            
-            printf("Waiter %c taking order from customer %d (party size: %d)\n", 
-                   waiter_name, customer_id, count);
-                   
-            put(semid, MUTEX_SEM);
-            
-            // Simulate time to take order (1 minute)
-            update_time(shm, 1);
-            
-            // Add order to cook queue
-            take(semid, MUTEX_SEM);
-            add_cooking_request(shm, waiter_id, customer_id, count);
-            printf("Waiter %c submitted order for customer %d to kitchen\n", waiter_name, customer_id);
-            
-            // Signal cook that new order is available
-            put(semid, MUTEX_SEM);
-            put(semid, COOK_SEM);
+        
+        // Check if there's a new customer order to process, else help out
+        // the busiest waiter
+        if (get_waiter_request(shm, waiter_id, &order)) {
+            take_order(shm, semid, waiter_id, &order, 0);
+            outstanding++;
+        } else if (shm->config.steal && steal_waiter_request(shm, waiter_id, &order)) {
+            take_order(shm, semid, waiter_id, &order, 1);
+            outstanding++;
         } else {
-            put(semid, MUTEX_SEM);
+            atomic_store(&WAITER_AREA(shm, waiter_id)->idle, 1);
+            decision_end(shm, semid, -1);
         }
     }
     
+    vclock_leave(shm, semid);
+    
+    log_event(shm, EV_WAITER_TERMINATED, waiter_id, 0, 0, 0);
+    
     // Detach from shared memory
     shmdt(shm);
-    printf("Waiter %c terminated\n", waiter_name);
     exit(0);
 }
 
-int main() {
+int main(int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "N:")) != -1) {
+        switch (opt) {
+        case 'N': set_instance(optarg); break;   // Session to join
+        default:
+            fprintf(stderr, "Usage: %s [-N instance]\n", argv[0]);
+            exit(1);
+        }
+    }
+    
     // Set up signal handlers
     signal(SIGINT, cleanup_handler);
     signal(SIGTERM, cleanup_handler);
@@ -101,28 +150,40 @@ int main() {
         exit(1);
     }
     
-    semid = semget(key, TOTAL_SEMS, 0666);
+    shared_t *shm = attach_shared_memory(shmid);
+    int num_waiters = shm->config.waiters;
+    
+    semid = semset_get(0, 0666);
     if (semid == -1) {
         perror("semget in waiter");
         exit(1);
     }
     
     // Fork waiter processes
-    pid_t waiter_pids[NUM_WAITERS];
+    pid_t *waiter_pids = malloc(num_waiters * sizeof(pid_t));
+    if (waiter_pids == NULL) {
+        perror("malloc");
+        exit(1);
+    }
     
-    for (int i = 0; i < NUM_WAITERS; i++) {
+    for (int i = 0; i < num_waiters; i++) {
+        vclock_join(shm, semid);
+        fflush(stdout);
         waiter_pids[i] = fork();
         if (waiter_pids[i] == 0) {
             // Child process - waiter
             wmain(i, shmid, semid);
             exit(0);
         }
+        atomic_fetch_add(&shm->staffed.waiters, 1);
     }
+    shmdt(shm);
     
     // Wait for all waiter processes to finish
-    for (int i = 0; i < NUM_WAITERS; i++) {
+    for (int i = 0; i < num_waiters; i++) {
         waitpid(waiter_pids[i], NULL, 0);
     }
+    free(waiter_pids);
     
     printf("All waiters have finished. Exiting waiter parent process.\n");
     